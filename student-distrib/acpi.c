@@ -0,0 +1,221 @@
+/*************************************************/
+/* acpi.c - Finds the processors and APICs.      */
+/*************************************************/
+#include "acpi.h"
+#include "lib.h"
+#include "frames.h"
+
+
+
+/* What the MADT says about the machine. */
+acpi_info_t acpi_info;
+
+
+
+/*
+ * acpi_checksum()
+ *
+ * Description:
+ * Adds up the bytes of an ACPI structure, which sum to 0 when it is valid.
+ *
+ * Inputs:
+ * addr: the structure
+ * length: its length in bytes
+ * Retvals: the sum, modulo 256
+ */
+static uint8_t acpi_checksum(const void * addr, uint32_t length)
+{
+	/* Local variables. */
+	uint8_t sum = 0;
+	uint32_t i;
+
+	for( i = 0; i < length; i++ )
+	{
+		sum += ((const uint8_t *)addr)[i];
+	}
+
+	return sum;
+}
+
+/*
+ * acpi_table_ok()
+ *
+ * Description:
+ * Tells whether an ACPI table can be read -- it lies in directly mapped
+ * memory -- and is valid.
+ *
+ * Inputs: addr - the physical address of the table
+ * Retvals: 1 if it is, 0 otherwise
+ */
+static uint32_t acpi_table_ok(uint32_t addr)
+{
+	/* Local variables. */
+	acpi_header_t * header = (acpi_header_t *)addr;
+
+	if( addr < _4KB || addr + sizeof(acpi_header_t) > DIRECT_MAP_LIMIT ||
+	    addr + header->length > DIRECT_MAP_LIMIT )
+	{
+		return 0;
+	}
+
+	return acpi_checksum(header, header->length) == 0;
+}
+
+/*
+ * acpi_find_rsdp()
+ *
+ * Description:
+ * Looks for the RSDP in the BIOS area below 1MB. The EBDA is not searched,
+ * since the page holding the pointer to it is left unmapped; QEMU and Bochs
+ * both put the RSDP in the BIOS area.
+ *
+ * Inputs: none
+ * Retvals:
+ * NULL: there is no RSDP
+ * the RSDP otherwise
+ */
+static rsdp_t * acpi_find_rsdp(void)
+{
+	/* Local variables. */
+	uint32_t addr;
+
+	for( addr = RSDP_SEARCH_START; addr < RSDP_SEARCH_END; addr += RSDP_ALIGN )
+	{
+		if( 0 == strncmp((const int8_t *)addr, "RSD PTR ", 8) &&
+		    0 == acpi_checksum((const void *)addr, sizeof(rsdp_t)) )
+		{
+			return (rsdp_t *)addr;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * acpi_parse_madt()
+ *
+ * Description:
+ * Records the processors, the first I/O APIC and the ISA interrupt source
+ * overrides listed in the MADT.
+ *
+ * Inputs: madt - the MADT
+ * Retvals: none
+ */
+static void acpi_parse_madt(madt_t * madt)
+{
+	/* Local variables. */
+	uint8_t * entry;
+	uint8_t * end;
+	uint32_t irq;
+
+	entry = (uint8_t *)madt + sizeof(madt_t);
+	end = (uint8_t *)madt + madt->header.length;
+
+	acpi_info.num_cpus = 0;
+	while( entry + sizeof(madt_entry_t) <= end && ((madt_entry_t *)entry)->length != 0 )
+	{
+		switch( ((madt_entry_t *)entry)->type )
+		{
+			/* Processor: ACPI ID, APIC ID, flags. */
+			case MADT_LOCAL_APIC:
+				if( (*(uint32_t *)(entry + 4) & MADT_CPU_ENABLED) &&
+				    acpi_info.num_cpus < MAX_CPUS )
+				{
+					acpi_info.cpu_apic_ids[acpi_info.num_cpus++] = entry[3];
+				}
+				break;
+
+			/* I/O APIC: ID, reserved, address, first GSI. */
+			case MADT_IO_APIC:
+				if( acpi_info.ioapic_addr == 0 )
+				{
+					acpi_info.ioapic_addr = *(uint32_t *)(entry + 4);
+					acpi_info.ioapic_gsi_base = *(uint32_t *)(entry + 8);
+				}
+				break;
+
+			/* Interrupt source override: bus, IRQ, GSI, flags. */
+			case MADT_IRQ_OVERRIDE:
+				irq = entry[3];
+				if( irq < NUM_ISA_IRQS )
+				{
+					acpi_info.isa_gsi[irq] = *(uint32_t *)(entry + 4);
+					acpi_info.isa_flags[irq] = *(uint16_t *)(entry + 8);
+				}
+				break;
+		}
+
+		entry += ((madt_entry_t *)entry)->length;
+	}
+}
+
+/*
+ * acpi_init()
+ *
+ * Description:
+ * Finds the MADT through the RSDP and RSDT, and reads it. Without one, the
+ * machine is taken to have a single processor and no I/O APIC. Tables are
+ * only read where they are directly mapped, below DIRECT_MAP_LIMIT, which
+ * is where QEMU puts them with its default 128MB of memory.
+ *
+ * Inputs: none
+ * Retvals:
+ * -1: no usable MADT
+ * 0: success
+ */
+int32_t acpi_init(void)
+{
+	/* Local variables. */
+	rsdp_t * rsdp;
+	acpi_header_t * rsdt;
+	uint32_t * tables;
+	uint32_t num_tables;
+	uint32_t i;
+
+	memset(&acpi_info, 0, sizeof(acpi_info_t));
+	for( i = 0; i < NUM_ISA_IRQS; i++ )
+	{
+		acpi_info.isa_gsi[i] = i;
+	}
+	acpi_info.num_cpus = 1;
+
+	rsdp = acpi_find_rsdp();
+	if( rsdp == NULL || !acpi_table_ok(rsdp->rsdt_addr) )
+	{
+		return -1;
+	}
+
+	rsdt = (acpi_header_t *)rsdp->rsdt_addr;
+	tables = (uint32_t *)((uint8_t *)rsdt + sizeof(acpi_header_t));
+	num_tables = (rsdt->length - sizeof(acpi_header_t)) / sizeof(uint32_t);
+
+	for( i = 0; i < num_tables; i++ )
+	{
+		if( acpi_table_ok(tables[i]) &&
+		    0 == strncmp(((acpi_header_t *)tables[i])->signature, "APIC", 4) )
+		{
+			acpi_parse_madt((madt_t *)tables[i]);
+			if( acpi_info.num_cpus == 0 )
+			{
+				acpi_info.num_cpus = 1;
+			}
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+/*
+ * acpi_get_info()
+ *
+ * Description:
+ * Returns what the MADT says about the machine. Only valid after acpi_init.
+ *
+ * Inputs: none
+ * Retvals: the information
+ */
+acpi_info_t * acpi_get_info(void)
+{
+	return &acpi_info;
+}
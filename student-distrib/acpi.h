@@ -0,0 +1,94 @@
+/*************************************************/
+/* acpi.h - Finds the processors and APICs.      */
+/*************************************************/
+#ifndef ACPI_H
+#define ACPI_H
+
+
+
+#include "types.h"
+#include "x86_desc.h"
+
+
+
+/* Where the BIOS may keep the RSDP. */
+#define RSDP_SEARCH_START     0xE0000
+#define RSDP_SEARCH_END       0x100000
+#define RSDP_ALIGN            16
+
+/* MADT entry types. */
+#define MADT_LOCAL_APIC       0
+#define MADT_IO_APIC          1
+#define MADT_IRQ_OVERRIDE     2
+#define MADT_CPU_ENABLED      0x1
+
+/* The ISA IRQs, which interrupt source overrides remap. */
+#define NUM_ISA_IRQS          16
+
+
+
+/* The Root System Description Pointer. */
+typedef struct __attribute__((packed)) rsdp_t {
+	int8_t signature[8];              // "RSD PTR "
+	uint8_t checksum;
+	int8_t oem_id[6];
+	uint8_t revision;
+	uint32_t rsdt_addr;
+} rsdp_t;
+
+/* The header every ACPI table starts with. */
+typedef struct __attribute__((packed)) acpi_header_t {
+	int8_t signature[4];
+	uint32_t length;
+	uint8_t revision;
+	uint8_t checksum;
+	int8_t oem_id[6];
+	int8_t oem_table_id[8];
+	uint32_t oem_revision;
+	uint32_t creator_id;
+	uint32_t creator_revision;
+} acpi_header_t;
+
+/* The Multiple APIC Description Table, followed by its entries. */
+typedef struct __attribute__((packed)) madt_t {
+	acpi_header_t header;             // "APIC"
+	uint32_t lapic_addr;
+	uint32_t flags;
+} madt_t;
+
+/* The header of each MADT entry. */
+typedef struct __attribute__((packed)) madt_entry_t {
+	uint8_t type;
+	uint8_t length;
+} madt_entry_t;
+
+/* Explanation:
+ * What the MADT says about the machine.
+ *    num_cpus -- The number of enabled processors (at least 1).
+ *    cpu_apic_ids -- Their local APIC IDs, in MADT order.
+ *    ioapic_addr -- The address of the first I/O APIC, or 0 if there is none.
+ *    ioapic_gsi_base -- The first global system interrupt it handles.
+ *    isa_gsi -- The global system interrupt each ISA IRQ arrives on.
+ *    isa_flags -- The polarity and trigger flags of each ISA IRQ (0 for the
+ *                 ISA default: active high, edge triggered).
+ */
+typedef struct acpi_info_t {
+	uint32_t num_cpus;
+	uint8_t cpu_apic_ids[MAX_CPUS];
+	uint32_t ioapic_addr;
+	uint32_t ioapic_gsi_base;
+	uint32_t isa_gsi[NUM_ISA_IRQS];
+	uint16_t isa_flags[NUM_ISA_IRQS];
+} acpi_info_t;
+
+
+
+/* Reads the MADT. */
+int32_t acpi_init(void);
+
+/* Returns what the MADT says about the machine. */
+acpi_info_t * acpi_get_info(void);
+
+
+
+#endif /* ACPI_H */
@@ -0,0 +1,372 @@
+/*************************************************/
+/* apic.c - The local APIC and its timer.        */
+/*************************************************/
+#include "apic.h"
+#include "lib.h"
+#include "scheduler.h"
+#include "idt.h"
+
+
+
+/* The local APIC's registers, or 0 if it is not in use. */
+uint32_t lapic_base;
+
+/*
+ * The timer calibration done by apic_timer_init: local APIC timer counts
+ * and TSC cycles over the same DIVISOR_100HZ (10ms) of PIT counts.
+ */
+uint32_t apic_counts_per_10ms;
+uint32_t apic_tsc_per_10ms;
+
+/* The mode picked for the timer. */
+uint32_t apic_timer_mode;
+
+
+
+/*
+ * lapic_read()
+ *
+ * Description:
+ * Reads a local APIC register.
+ *
+ * Inputs: reg - the offset of the register
+ * Retvals: its value
+ */
+static uint32_t lapic_read(uint32_t reg)
+{
+	return *(volatile uint32_t *)(lapic_base + reg);
+}
+
+/*
+ * lapic_write()
+ *
+ * Description:
+ * Writes a local APIC register.
+ *
+ * Inputs:
+ * reg: the offset of the register
+ * value: what to write
+ * Retvals: none
+ */
+static void lapic_write(uint32_t reg, uint32_t value)
+{
+	*(volatile uint32_t *)(lapic_base + reg) = value;
+}
+
+/*
+ * apic_init()
+ *
+ * Description:
+ * Turns the local APIC on, if the processor has one at its usual address
+ * (the only one paging maps). The 8259s keep delivering device interrupts
+ * to the boot processor through LINT0 in virtual wire mode, until the
+ * I/O APIC takes over (see ioapic_init); the other processors leave
+ * LINT0 masked.
+ *
+ * Inputs: none
+ * Retvals:
+ * -1: there is no usable local APIC
+ * 0: success
+ */
+int32_t apic_init(void)
+{
+	/* Local variables. */
+	uint32_t eax, ebx, ecx, edx;
+	uint64_t base;
+
+	cpuid(CPUID_FEATURES, &eax, &ebx, &ecx, &edx);
+	if( !(edx & CPUID_EDX_APIC) )
+	{
+		return -1;
+	}
+
+	base = rdmsr(MSR_APIC_BASE);
+	if( ((uint32_t)base & APIC_BASE_ADDR_MASK) < DEVICE_MAP_BASE )
+	{
+		return -1;
+	}
+	wrmsr(MSR_APIC_BASE, base | APIC_BASE_ENABLE);
+	lapic_base = (uint32_t)base & APIC_BASE_ADDR_MASK;
+
+	lapic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | APIC_SPURIOUS_INT);
+	lapic_write(LAPIC_LVT_LINT0, ((uint32_t)base & APIC_BASE_BSP) ? LAPIC_LVT_EXTINT : LAPIC_LVT_MASKED);
+	lapic_write(LAPIC_LVT_LINT1, LAPIC_LVT_NMI);
+	lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED);
+	lapic_write(LAPIC_TPR, 0);
+
+	return 0;
+}
+
+/*
+ * apic_disable_extint()
+ *
+ * Description:
+ * Masks LINT0, so the 8259s' interrupts no longer come in. Called once
+ * the I/O APIC delivers the device interrupts instead.
+ *
+ * Inputs: none
+ * Retvals: none
+ */
+void apic_disable_extint(void)
+{
+	lapic_write(LAPIC_LVT_LINT0, LAPIC_LVT_MASKED);
+}
+
+/*
+ * apic_id()
+ *
+ * Description:
+ * Returns the local APIC ID of the processor running this.
+ *
+ * Inputs: none
+ * Retvals: the ID (0 if there is no local APIC)
+ */
+uint32_t apic_id(void)
+{
+	if( lapic_base == 0 )
+	{
+		return 0;
+	}
+
+	return lapic_read(LAPIC_ID) >> LAPIC_ID_SHIFT;
+}
+
+/*
+ * apic_send_icr()
+ *
+ * Description:
+ * Sends an interprocessor interrupt, once the last one has been accepted.
+ *
+ * Inputs:
+ * apic_id: the local APIC ID of the target processor
+ * command: the low half of the interrupt command register
+ * Retvals: none
+ */
+static void apic_send_icr(uint32_t apic_id, uint32_t command)
+{
+	while( lapic_read(LAPIC_ICR_LOW) & ICR_PENDING );
+
+	lapic_write(LAPIC_ICR_HIGH, apic_id << ICR_DEST_SHIFT);
+	lapic_write(LAPIC_ICR_LOW, command);
+}
+
+/*
+ * apic_send_ipi()
+ *
+ * Description:
+ * Sends an interrupt to another processor.
+ *
+ * Inputs:
+ * apic_id: the local APIC ID of the target processor
+ * vector: the interrupt vector
+ * Retvals: none
+ */
+void apic_send_ipi(uint32_t apic_id, uint32_t vector)
+{
+	apic_send_icr(apic_id, ICR_FIXED | ICR_ASSERT | vector);
+}
+
+/*
+ * apic_start_cpu()
+ *
+ * Description:
+ * Starts another processor the way the MP specification says: an INIT,
+ * 10ms, then two STARTUPs 200us apart. The processor starts in real mode
+ * at the beginning of physical page 'page'.
+ *
+ * Inputs:
+ * apic_id: the local APIC ID of the processor
+ * page: the page number of its first instruction (below 1MB)
+ * Retvals: none
+ */
+void apic_start_cpu(uint32_t apic_id, uint32_t page)
+{
+	apic_send_icr(apic_id, ICR_INIT | ICR_ASSERT);
+	pit_wait(DIVISOR_100HZ);
+
+	apic_send_icr(apic_id, ICR_STARTUP | ICR_ASSERT | page);
+	pit_wait(PIT_COUNTS_200US);
+	apic_send_icr(apic_id, ICR_STARTUP | ICR_ASSERT | page);
+	pit_wait(PIT_COUNTS_200US);
+}
+
+/*
+ * apic_stop_cpu()
+ *
+ * Description:
+ * Sends another processor an INIT, which stops whatever it is running and
+ * leaves it waiting for a STARTUP that never comes.
+ *
+ * Inputs: apic_id - the local APIC ID of the processor
+ * Retvals: none
+ */
+void apic_stop_cpu(uint32_t apic_id)
+{
+	apic_send_icr(apic_id, ICR_INIT | ICR_ASSERT);
+}
+
+/*
+ * apic_timer_init()
+ *
+ * Description:
+ * Calibrates the local APIC timer against the PIT, by letting it count
+ * down while PIT channel 2 counts DIVISOR_100HZ, and picks its mode:
+ * TSC-deadline where the processor has it, one-shot otherwise. Both
+ * interrupt once per programming, which is what the scheduler's dynamic
+ * tick wants. Must run after apic_init.
+ *
+ * Inputs: none
+ * Retvals:
+ * APIC_TIMER_NONE: there is no usable local APIC timer
+ * APIC_TIMER_ONESHOT or APIC_TIMER_DEADLINE: the mode now in use
+ */
+uint32_t apic_timer_init(void)
+{
+	/* Local variables. */
+	uint32_t eax, ebx, ecx, edx;
+	uint64_t start;
+
+	if( lapic_base == 0 )
+	{
+		return APIC_TIMER_NONE;
+	}
+
+	lapic_write(LAPIC_TIMER_DIVIDE, LAPIC_DIVIDE_BY_16);
+	lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED | LAPIC_TIMER_ONESHOT);
+
+	start = rdtsc();
+	lapic_write(LAPIC_TIMER_INITIAL, 0xFFFFFFFF);
+	pit_wait(DIVISOR_100HZ);
+	apic_counts_per_10ms = 0xFFFFFFFF - lapic_read(LAPIC_TIMER_CURRENT);
+	apic_tsc_per_10ms = (uint32_t)(rdtsc() - start);
+	lapic_write(LAPIC_TIMER_INITIAL, 0);
+
+	if( apic_counts_per_10ms == 0 || apic_tsc_per_10ms == 0 )
+	{
+		return APIC_TIMER_NONE;
+	}
+
+	cpuid(CPUID_FEATURES, &eax, &ebx, &ecx, &edx);
+	if( ecx & CPUID_ECX_TSC_DEADLINE )
+	{
+		apic_timer_mode = APIC_TIMER_DEADLINE;
+	}
+	else
+	{
+		apic_timer_mode = APIC_TIMER_ONESHOT;
+	}
+
+	apic_timer_enable();
+	return apic_timer_mode;
+}
+
+/*
+ * apic_timer_enable()
+ *
+ * Description:
+ * Sets up the local APIC timer of the processor running this in the mode
+ * apic_timer_init picked. The processors share one bus clock, so its
+ * calibration holds for all of them.
+ *
+ * Inputs: none
+ * Retvals: none
+ */
+void apic_timer_enable(void)
+{
+	lapic_write(LAPIC_TIMER_DIVIDE, LAPIC_DIVIDE_BY_16);
+
+	if( apic_timer_mode == APIC_TIMER_DEADLINE )
+	{
+		lapic_write(LAPIC_LVT_TIMER, LAPIC_TIMER_DEADLINE | APIC_TIMER_INT);
+	}
+	else if( apic_timer_mode == APIC_TIMER_ONESHOT )
+	{
+		lapic_write(LAPIC_LVT_TIMER, LAPIC_TIMER_ONESHOT | APIC_TIMER_INT);
+	}
+}
+
+/*
+ * apic_timer_get_mode()
+ *
+ * Description:
+ * Returns the timer mode picked by apic_timer_init.
+ *
+ * Inputs: none
+ * Retvals: APIC_TIMER_NONE, APIC_TIMER_ONESHOT or APIC_TIMER_DEADLINE
+ */
+uint32_t apic_timer_get_mode(void)
+{
+	return apic_timer_mode;
+}
+
+/*
+ * apic_timer_arm()
+ *
+ * Description:
+ * Programs a single timer interrupt for when the TSC reaches 'tsc_target'.
+ * In TSC-deadline mode that is one MSR write; in one-shot mode the wait
+ * is converted into timer counts. Waits of a second or more are cut short.
+ *
+ * Inputs:
+ * tsc_target: when to interrupt
+ * tsc_now: the TSC now
+ * Retvals: none
+ */
+void apic_timer_arm(uint64_t tsc_target, uint64_t tsc_now)
+{
+	/* Local variables. */
+	uint64_t wait;
+	uint32_t count;
+
+	if( apic_timer_mode == APIC_TIMER_DEADLINE )
+	{
+		/* A deadline of 0 would disarm the timer instead. */
+		wrmsr(MSR_TSC_DEADLINE, tsc_target != 0 ? tsc_target : 1);
+		return;
+	}
+
+	wait = tsc_target > tsc_now ? tsc_target - tsc_now : 0;
+	if( wait > (uint64_t)apic_tsc_per_10ms * 100 )
+	{
+		wait = (uint64_t)apic_tsc_per_10ms * 100;
+	}
+
+	count = div64_32(wait * apic_counts_per_10ms, apic_tsc_per_10ms);
+	lapic_write(LAPIC_TIMER_INITIAL, count != 0 ? count : 1);
+}
+
+/*
+ * apic_timer_stop()
+ *
+ * Description:
+ * Cancels the pending timer interrupt, if any.
+ *
+ * Inputs: none
+ * Retvals: none
+ */
+void apic_timer_stop(void)
+{
+	if( apic_timer_mode == APIC_TIMER_DEADLINE )
+	{
+		wrmsr(MSR_TSC_DEADLINE, 0);
+	}
+	else
+	{
+		lapic_write(LAPIC_TIMER_INITIAL, 0);
+	}
+}
+
+/*
+ * apic_eoi()
+ *
+ * Description:
+ * Signals the end of a local APIC interrupt: a single memory write,
+ * instead of the port writes send_eoi makes.
+ *
+ * Inputs: none
+ * Retvals: none
+ */
+void apic_eoi(void)
+{
+	lapic_write(LAPIC_EOI, 0);
+}
@@ -0,0 +1,110 @@
+/*************************************************/
+/* apic.h - The local APIC and its timer.        */
+/*************************************************/
+#ifndef APIC_H
+#define APIC_H
+
+
+
+#include "types.h"
+
+
+
+/*
+ * The 4MB of physical address space holding the I/O APIC (0xFEC00000) and
+ * the local APIC (0xFEE00000), mapped uncached into every page directory.
+ */
+#define DEVICE_MAP_BASE       0xFEC00000
+#define DEVICE_MAP_PDE        (DEVICE_MAP_BASE / _4MB)
+
+/* CPUID leaf 1 feature bits. */
+#define CPUID_FEATURES        1
+#define CPUID_EDX_APIC        (1 << 9)
+#define CPUID_ECX_TSC_DEADLINE (1 << 24)
+
+/* Model specific registers. */
+#define MSR_APIC_BASE         0x1B
+#define MSR_TSC_DEADLINE      0x6E0
+#define APIC_BASE_ENABLE      (1 << 11)
+#define APIC_BASE_BSP         (1 << 8)
+#define APIC_BASE_ADDR_MASK   0xFFFFF000
+
+/* Local APIC register offsets. */
+#define LAPIC_ID              0x020
+#define LAPIC_TPR             0x080
+#define LAPIC_EOI             0x0B0
+#define LAPIC_SVR             0x0F0
+#define LAPIC_LVT_TIMER       0x320
+#define LAPIC_LVT_LINT0       0x350
+#define LAPIC_LVT_LINT1       0x360
+#define LAPIC_TIMER_INITIAL   0x380
+#define LAPIC_TIMER_CURRENT   0x390
+#define LAPIC_TIMER_DIVIDE    0x3E0
+#define LAPIC_ICR_LOW         0x300
+#define LAPIC_ICR_HIGH        0x310
+
+/* Local APIC register values. */
+#define LAPIC_SVR_ENABLE      0x100
+#define LAPIC_LVT_MASKED      0x10000
+#define LAPIC_LVT_EXTINT      0x700
+#define LAPIC_LVT_NMI         0x400
+#define LAPIC_TIMER_ONESHOT   0x00000
+#define LAPIC_TIMER_PERIODIC  0x20000
+#define LAPIC_TIMER_DEADLINE  0x40000
+#define LAPIC_DIVIDE_BY_16    0x3
+#define LAPIC_ID_SHIFT        24
+
+/* Interrupt command register values. */
+#define ICR_FIXED             0x00000
+#define ICR_INIT              0x00500
+#define ICR_STARTUP           0x00600
+#define ICR_PENDING           0x01000
+#define ICR_ASSERT            0x04000
+#define ICR_DEST_SHIFT        24
+
+/* Timer modes, as chosen by apic_timer_init. */
+#define APIC_TIMER_NONE       0
+#define APIC_TIMER_ONESHOT    1
+#define APIC_TIMER_DEADLINE   2
+
+
+
+/* Turns the local APIC on, if the processor has one. */
+int32_t apic_init(void);
+
+/* Stops the 8259s' interrupts coming in through LINT0. */
+void apic_disable_extint(void);
+
+/* Returns the local APIC ID of the processor running this. */
+uint32_t apic_id(void);
+
+/* Sends an interrupt to another processor. */
+void apic_send_ipi(uint32_t apic_id, uint32_t vector);
+
+/* Sends INIT, then two STARTUPs, to start another processor at 'page'. */
+void apic_start_cpu(uint32_t apic_id, uint32_t page);
+
+/* Sends INIT to park another processor. */
+void apic_stop_cpu(uint32_t apic_id);
+
+/* Calibrates the local APIC timer and picks its mode. */
+uint32_t apic_timer_init(void);
+
+/* Sets up the timer of another processor, as calibrated by apic_timer_init. */
+void apic_timer_enable(void);
+
+/* Returns the timer mode picked by apic_timer_init. */
+uint32_t apic_timer_get_mode(void);
+
+/* Programs a single timer interrupt at the given TSC value. */
+void apic_timer_arm(uint64_t tsc_target, uint64_t tsc_now);
+
+/* Cancels the pending timer interrupt. */
+void apic_timer_stop(void);
+
+/* Signals the end of a local APIC interrupt. */
+void apic_eoi(void);
+
+
+
+#endif /* APIC_H */
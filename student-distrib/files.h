@@ -16,6 +16,14 @@
 #define MAX_FILENAME_LENGTH  32
 #define FS_PAGE_SIZE         0x1000 // 4kB
 #define FS_STATS_SIZE        64
+#define MAX_DATA_BLOCKS      1023
+
+/* Dentry hash index constants. */
+#define FS_HASH_BUCKETS      128  // must be a power of two
+#define FS_HASH_EMPTY        0xFF
+#define FNV_OFFSET_BASIS     0x811C9DC5
+#define FNV_PRIME            0x01000193
+#define FS_BENCH_ITERATIONS  10000
 
 
 
@@ -45,9 +53,54 @@ typedef struct {
  */
 typedef struct{
 	uint32_t size;
-	uint32_t data_blocks[1023];
+	uint32_t data_blocks[MAX_DATA_BLOCKS];
 } inode_t;
 
+struct file_descriptor_t;
+
+/* Explanation:
+ * The file operations table shared by every open file of one kind (stdin,
+ * stdout, rtc, regular file, directory). Every operation is handed the
+ * open file descriptor itself so it can keep its own state there. A NULL
+ * entry means the operation is not supported and the system call fails.
+ */
+typedef struct fops_t {
+	int32_t (*open)(struct file_descriptor_t * fd);
+	int32_t (*read)(struct file_descriptor_t * fd, void * buf, int32_t nbytes);
+	int32_t (*write)(struct file_descriptor_t * fd, const void * buf, int32_t nbytes);
+	int32_t (*close)(struct file_descriptor_t * fd);
+} fops_t;
+
+/* Explanation: 
+ * This is the file descriptor used in the fds array for each process's PCB
+ *    fops -- A pointer to the file operations table for this file.
+ *    inode -- The inode of this file in the file system, resolved at open.
+ *    fileposition -- The current position within the file that we are reading.
+ *                    This will increment through the file as we read it.
+ *    block_index -- The index within the inode of the data block holding 
+ *                   'fileposition', valid whenever block_addr is not NULL.
+ *    block_addr -- The address of that data block, so that sequential reads 
+ *                  only touch the inode when they cross into the next block.
+ *    flags -- The only flag contained within this member is IN_USE or NOT_IN_USE.
+ *             It is used to figure out which fds are available for use when trying
+ *             to open a new file in a process.
+ *    driver_data -- The state a device driver keeps for this open file (the 
+ *                   rtc's virtual clock), or NULL.
+ *    map_start -- The first slot of the mmap window the file is mapped at.
+ *    map_pages -- How many slots it takes there, or 0 if it is not mapped.
+ */
+typedef struct file_descriptor_t {
+	const fops_t * fops;
+	inode_t * inode;
+	uint32_t fileposition;
+	uint32_t block_index;
+	uint8_t * block_addr;
+	int32_t flags;
+	void * driver_data;
+	uint32_t map_start;
+	uint32_t map_pages;
+} file_descriptor_t;
+
 
 
 /* Opens the file system by calling fs_init. */
@@ -68,6 +121,12 @@ int32_t fs_load(const int8_t * fname, uint32_t address);
 /* Initializes global variables associated with the file system. */
 void fs_init(uint32_t fs_start, uint32_t fs_end);
 
+/* Hashes a (possibly unterminated) 32-byte filename, returning its length. */
+uint32_t fs_hash_name(const uint8_t * fname, uint32_t * length);
+
+/* Builds the hashed dentry index used by read_dentry_by_name. */
+void fs_build_index(void);
+
 /* Returns directory entry information from the given name */
 int32_t read_dentry_by_name(const uint8_t * fname, dentry_t * dentry);
 
@@ -77,32 +136,44 @@ int32_t read_dentry_by_index(uint32_t index, dentry_t * dentry);
 /* Reads bytes starting from 'offset' in the file with the inode 'inode'. */
 int32_t read_data(uint32_t inode, uint32_t offset, uint8_t * buf, uint32_t length); 
 
+/* Returns a pointer to the inode with the given number. */
+inode_t * fs_get_inode(uint32_t inode);
+
+/* Returns the address of the 'index'th data block of a file. */
+uint8_t * fs_block_address(inode_t * inode, uint32_t index);
+
+/* Returns 1 if the data blocks are page aligned and can be mapped directly. */
+int32_t fs_blocks_mappable(void);
+
 /* Test function for the file system driver.  */		  
 void files_test(void);
 
-/* Returns 0 */
-int32_t file_open(void);
+/* Compares hashed and linear dentry lookup cost for hits and misses. */
+void files_bench(void);
+
+/* Resets the block cursor of a newly opened file. */
+int32_t file_open(file_descriptor_t * fd);
 
 /* Returns 0 */
-int32_t file_close(void);
+int32_t file_close(file_descriptor_t * fd);
 
-/* Performs a fs_read. */
-int32_t file_read( uint8_t * buf, uint32_t length, const int8_t * fname, uint32_t offset );
+/* Reads from the file at the descriptor's current position. */
+int32_t file_read(file_descriptor_t * fd, void * buf, int32_t nbytes);
 
 /* Returns -1 */
-int32_t file_write(void);
+int32_t file_write(file_descriptor_t * fd, const void * buf, int32_t nbytes);
 
 /* Returns 0 */
-int32_t dir_open(void);
+int32_t dir_open(file_descriptor_t * fd);
 
 /* Returns 0 */
-int32_t dir_close(void);
+int32_t dir_close(file_descriptor_t * fd);
 
 /* Implements ls. */
-int32_t dir_read(uint8_t * buf);
+int32_t dir_read(file_descriptor_t * fd, void * buf, int32_t nbytes);
 
 /* Return -1 */
-int32_t dir_write(void);
+int32_t dir_write(file_descriptor_t * fd, const void * buf, int32_t nbytes);
 
 
 
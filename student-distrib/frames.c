@@ -0,0 +1,441 @@
+/*************************************************/
+/* frames.c - The physical page frame allocator. */
+/*************************************************/
+#include "frames.h"
+#include "lib.h"
+
+
+/*
+ * One bit per 4kB physical frame, set when the frame is in use (or does not
+ * exist). Frames only become free when the multiboot memory map says there
+ * is usable RAM behind them.
+ */
+uint32_t frame_bitmap[FRAME_BITMAP_WORDS];
+
+/* The number of frames currently free. */
+uint32_t free_frames;
+
+/* One past the highest usable frame, so searches stop at the end of RAM. */
+uint32_t frame_limit;
+
+/*
+ * Where the next search for a kernel (direct mapped) or user frame starts.
+ * Allocations tend to follow frees, so this avoids rescanning full words
+ * at the bottom of the bitmap every time.
+ */
+uint32_t kernel_frame_hint;
+uint32_t user_frame_hint;
+
+
+
+/*
+ * mark_frames()
+ *
+ * Description:
+ * Marks every frame overlapping [start, end) as used or free.
+ *
+ * Inputs:
+ * start, end: the physical address range
+ * used: 1 to mark the frames used, 0 to mark them free
+ *
+ * Retvals: none
+ */
+static void mark_frames(uint32_t start, uint32_t end, uint32_t used)
+{
+	/* Local variables. */
+	uint32_t frame;
+	uint32_t last;
+
+	/* Round outwards when reserving and inwards when freeing. */
+	if( used )
+	{
+		frame = start >> FRAME_SHIFT;
+		last = (end + FRAME_SIZE - 1) >> FRAME_SHIFT;
+	}
+	else
+	{
+		frame = (start + FRAME_SIZE - 1) >> FRAME_SHIFT;
+		last = end >> FRAME_SHIFT;
+	}
+	if( end == 0 )
+	{
+		last = MAX_FRAMES;
+	}
+
+	for( ; frame < last && frame < MAX_FRAMES; frame++ )
+	{
+		if( used && !(frame_bitmap[frame / 32] & (1 << (frame % 32))) )
+		{
+			frame_bitmap[frame / 32] |= (1 << (frame % 32));
+			free_frames--;
+		}
+		else if( !used && (frame_bitmap[frame / 32] & (1 << (frame % 32))) )
+		{
+			frame_bitmap[frame / 32] &= ~(1 << (frame % 32));
+			free_frames++;
+			if( frame >= frame_limit )
+			{
+				frame_limit = frame + 1;
+			}
+		}
+	}
+}
+
+/*
+ * frames_init()
+ *
+ * Description:
+ * Builds the free frame bitmap. Every usable region in the multiboot memory
+ * map is freed, then the low memory holding the kernel and the modules GRUB
+ * loaded (the file system image) are reserved again. Without a memory map
+ * the upper memory size from multiboot is used instead.
+ *
+ * Inputs:
+ * mbi: the multiboot information structure
+ *
+ * Retvals: none
+ */
+void frames_init(multiboot_info_t * mbi)
+{
+	/* Local variables. */
+	memory_map_t * mmap;
+	module_t * mod;
+	uint32_t i;
+	uint32_t end;
+
+	/* Start out with nothing free. */
+	memset(frame_bitmap, 0xFF, sizeof(frame_bitmap));
+	free_frames = 0;
+	frame_limit = 0;
+
+	if( mbi->flags & (1 << 6) )
+	{
+		for( mmap = (memory_map_t *) mbi->mmap_addr;
+		     (uint32_t) mmap < mbi->mmap_addr + mbi->mmap_length;
+		     mmap = (memory_map_t *) ((uint32_t) mmap + mmap->size + sizeof (mmap->size)) )
+		{
+			/* Only usable RAM that starts below 4GB is of any use to us. */
+			if( mmap->type != MMAP_TYPE_AVAILABLE || mmap->base_addr_high != 0 )
+			{
+				continue;
+			}
+
+			/* Clip regions that run past the top of the 32-bit space. */
+			end = mmap->base_addr_low + mmap->length_low;
+			if( mmap->length_high != 0 || end < mmap->base_addr_low )
+			{
+				end = 0;
+			}
+			mark_frames(mmap->base_addr_low, end, 0);
+		}
+	}
+	else if( mbi->flags & (1 << 0) )
+	{
+		/* mem_upper counts the kilobytes above 1MB. */
+		mark_frames(UPPER_MEMORY_START, UPPER_MEMORY_START + mbi->mem_upper * 1024, 0);
+	}
+
+	/* Keep the kernel's own memory and the modules out of the pool. */
+	mark_frames(0, RESERVED_LOW_MEMORY, 1);
+	if( mbi->flags & (1 << 3) )
+	{
+		mod = (module_t *) mbi->mods_addr;
+		for( i = 0; i < mbi->mods_count; i++ )
+		{
+			mark_frames(mod[i].mod_start, mod[i].mod_end, 1);
+		}
+	}
+
+	kernel_frame_hint = RESERVED_LOW_MEMORY >> FRAME_SHIFT;
+	user_frame_hint = DIRECT_MAP_LIMIT >> FRAME_SHIFT;
+}
+
+/*
+ * find_free_frame()
+ *
+ * Description:
+ * Looks for a free frame in [first, last), starting at '*hint' and wrapping
+ * around once. Full words are skipped 32 frames at a time.
+ *
+ * Inputs:
+ * first, last: the range of frame numbers to search
+ * hint: where to start, updated to the frame found
+ *
+ * Retvals:
+ * the frame number, or MAX_FRAMES if the range is full
+ */
+static uint32_t find_free_frame(uint32_t first, uint32_t last, uint32_t * hint)
+{
+	/* Local variables. */
+	uint32_t frame;
+	uint32_t scanned;
+	uint32_t span;
+
+	if( first >= last )
+	{
+		return MAX_FRAMES;
+	}
+	span = last - first;
+
+	frame = *hint;
+	if( frame < first || frame >= last )
+	{
+		frame = first;
+	}
+
+	for( scanned = 0; scanned < span; )
+	{
+		/* Skip a whole word at once when it is full and we are aligned to it. */
+		if( (frame % 32) == 0 && frame_bitmap[frame / 32] == FRAME_WORD_FULL &&
+		    frame + 32 <= last )
+		{
+			frame += 32;
+			scanned += 32;
+		}
+		else
+		{
+			if( !(frame_bitmap[frame / 32] & (1 << (frame % 32))) )
+			{
+				*hint = frame;
+				return frame;
+			}
+			frame++;
+			scanned++;
+		}
+
+		if( frame >= last )
+		{
+			frame = first;
+		}
+	}
+
+	return MAX_FRAMES;
+}
+
+/*
+ * frame_alloc()
+ *
+ * Description:
+ * Allocates one physical frame. Kernel frames come from the direct mapped
+ * region so the kernel can use them at their physical address. User frames
+ * only have to be mapped into a process, so they come from above the direct
+ * map first, leaving low memory for the kernel for as long as possible.
+ *
+ * Inputs:
+ * flags: FRAME_KERNEL or FRAME_USER
+ *
+ * Retvals:
+ * 0: failure (out of memory)
+ * the physical address of the frame otherwise
+ */
+uint32_t frame_alloc(uint32_t flags)
+{
+	/* Local variables. */
+	uint32_t frame;
+	uint32_t direct_limit;
+	uint32_t flags_saved;
+
+	direct_limit = DIRECT_MAP_LIMIT >> FRAME_SHIFT;
+	if( direct_limit > frame_limit )
+	{
+		direct_limit = frame_limit;
+	}
+
+	cli_and_save(flags_saved);
+
+	if( flags & FRAME_KERNEL )
+	{
+		frame = find_free_frame(0, direct_limit, &kernel_frame_hint);
+	}
+	else
+	{
+		frame = find_free_frame(direct_limit, frame_limit, &user_frame_hint);
+		if( frame == MAX_FRAMES )
+		{
+			frame = find_free_frame(0, direct_limit, &kernel_frame_hint);
+		}
+	}
+
+	if( frame == MAX_FRAMES )
+	{
+		restore_flags(flags_saved);
+		return 0;
+	}
+
+	frame_bitmap[frame / 32] |= (1 << (frame % 32));
+	free_frames--;
+
+	restore_flags(flags_saved);
+	return frame << FRAME_SHIFT;
+}
+
+/*
+ * frame_free()
+ *
+ * Description:
+ * Returns a frame from frame_alloc to the free pool.
+ *
+ * Inputs:
+ * phys_addr: the physical address of the frame
+ *
+ * Retvals: none
+ */
+void frame_free(uint32_t phys_addr)
+{
+	/* Local variables. */
+	uint32_t frame;
+	uint32_t flags;
+
+	frame = phys_addr >> FRAME_SHIFT;
+	if( frame >= frame_limit || phys_addr < RESERVED_LOW_MEMORY )
+	{
+		return;
+	}
+
+	cli_and_save(flags);
+	if( frame_bitmap[frame / 32] & (1 << (frame % 32)) )
+	{
+		frame_bitmap[frame / 32] &= ~(1 << (frame % 32));
+		free_frames++;
+	}
+	restore_flags(flags);
+}
+
+/*
+ * find_free_block()
+ *
+ * Description:
+ * Looks for 'count' free frames in a row, aligned to 'count', in the words
+ * of the bitmap covering [first, last). Since 'count' is a power of two no
+ * bigger than a word, an aligned block never straddles two words.
+ *
+ * Inputs:
+ * first, last: the range of frame numbers to search (multiples of 32)
+ * count: the number of frames wanted
+ * mask: 'count' set bits
+ *
+ * Retvals:
+ * the first frame number of the block, or MAX_FRAMES if there is none
+ */
+static uint32_t find_free_block(uint32_t first, uint32_t last, uint32_t count, uint32_t mask)
+{
+	/* Local variables. */
+	uint32_t word;
+	uint32_t bit;
+
+	for( word = first / 32; word < last / 32; word++ )
+	{
+		if( frame_bitmap[word] == FRAME_WORD_FULL )
+		{
+			continue;
+		}
+		for( bit = 0; bit < 32; bit += count )
+		{
+			if( !(frame_bitmap[word] & (mask << bit)) )
+			{
+				return word*32 + bit;
+			}
+		}
+	}
+
+	return MAX_FRAMES;
+}
+
+/*
+ * frame_alloc_block()
+ *
+ * Description:
+ * Allocates 'count' physically contiguous frames, aligned to a multiple of
+ * their total size (so an 8kB block of two frames is 8kB aligned). Used for
+ * memory that is addressed by masking, like the PCB and kernel stack.
+ *
+ * Inputs:
+ * count: the number of frames -- a power of two, at most 32
+ * flags: FRAME_KERNEL or FRAME_USER
+ *
+ * Retvals:
+ * 0: failure (bad count, or out of memory)
+ * the physical address of the first frame otherwise
+ */
+uint32_t frame_alloc_block(uint32_t count, uint32_t flags)
+{
+	/* Local variables. */
+	uint32_t frame;
+	uint32_t mask;
+	uint32_t direct_limit;
+	uint32_t flags_saved;
+
+	if( count == 0 || count > 32 || (count & (count - 1)) != 0 )
+	{
+		return 0;
+	}
+	mask = (count == 32) ? FRAME_WORD_FULL : (1 << count) - 1;
+
+	direct_limit = DIRECT_MAP_LIMIT >> FRAME_SHIFT;
+	if( direct_limit > frame_limit )
+	{
+		direct_limit = frame_limit & ~31;
+	}
+
+	cli_and_save(flags_saved);
+
+	frame = MAX_FRAMES;
+	if( !(flags & FRAME_KERNEL) )
+	{
+		frame = find_free_block(direct_limit, frame_limit & ~31, count, mask);
+	}
+	if( frame == MAX_FRAMES )
+	{
+		frame = find_free_block(0, direct_limit, count, mask);
+	}
+
+	if( frame == MAX_FRAMES )
+	{
+		restore_flags(flags_saved);
+		return 0;
+	}
+
+	frame_bitmap[frame / 32] |= mask << (frame % 32);
+	free_frames -= count;
+
+	restore_flags(flags_saved);
+	return frame << FRAME_SHIFT;
+}
+
+/*
+ * frame_free_block()
+ *
+ * Description:
+ * Returns a block from frame_alloc_block to the free pool.
+ *
+ * Inputs:
+ * phys_addr: the physical address of the first frame
+ * count: the number of frames in the block
+ *
+ * Retvals: none
+ */
+void frame_free_block(uint32_t phys_addr, uint32_t count)
+{
+	/* Local variables. */
+	uint32_t i;
+
+	for( i = 0; i < count; i++ )
+	{
+		frame_free(phys_addr + i*FRAME_SIZE);
+	}
+}
+
+/*
+ * frames_free_count()
+ *
+ * Description:
+ * Returns the number of free frames.
+ *
+ * Inputs: none
+ *
+ * Retvals: the number of free frames
+ */
+uint32_t frames_free_count(void)
+{
+	return free_frames;
+}
@@ -0,0 +1,59 @@
+/*************************************************/
+/* frames.h - The physical page frame allocator. */
+/*************************************************/
+#ifndef FRAMES_H
+#define FRAMES_H
+
+
+
+#include "types.h"
+#include "multiboot.h"
+
+
+
+/* Constants. */
+#define FRAME_SIZE           _4KB
+#define FRAME_SHIFT          12
+#define MAX_FRAMES           0x100000    // every 4kB frame of a 32-bit space
+#define FRAME_BITMAP_WORDS   (MAX_FRAMES / 32)
+#define FRAME_WORD_FULL      0xFFFFFFFF
+#define MMAP_TYPE_AVAILABLE  1
+#define UPPER_MEMORY_START   0x100000    // where multiboot's mem_upper begins
+
+/*
+ * Physical memory below this address is mapped one-to-one (supervisor only)
+ * in every page directory, so the kernel can reach any frame under it.
+ */
+#define DIRECT_MAP_LIMIT     _128MB
+#define DIRECT_MAP_FIRST_PDE 2
+
+/* Everything below this is the BIOS area, video memory, the kernel and its stacks. */
+#define RESERVED_LOW_MEMORY  _8MB
+
+/* Allocation flags. */
+#define FRAME_USER           0x0    // only ever touched through a user mapping
+#define FRAME_KERNEL         0x1    // must be reachable through the direct map
+
+
+
+/* Builds the free frame bitmap from the multiboot memory map. */
+void frames_init(multiboot_info_t * mbi);
+
+/* Allocates one frame, returning its physical address or 0 on failure. */
+uint32_t frame_alloc(uint32_t flags);
+
+/* Returns a frame from frame_alloc to the free pool. */
+void frame_free(uint32_t phys_addr);
+
+/* Allocates 'count' contiguous frames aligned to their total size. */
+uint32_t frame_alloc_block(uint32_t count, uint32_t flags);
+
+/* Returns a block from frame_alloc_block to the free pool. */
+void frame_free_block(uint32_t phys_addr, uint32_t count);
+
+/* Returns the number of free frames. */
+uint32_t frames_free_count(void);
+
+
+
+#endif /* FRAMES_H */
@@ -3,6 +3,8 @@
 /**********************************************************************/
 #include "i8259.h"
 #include "lib.h"
+#include "apic.h"
+#include "ioapic.h"
 
 
 /*** Interrupt masks to determine which interrupts are enabled and disabled ***/
@@ -63,122 +65,97 @@ void i8259_init(void)
  * enable_irq()
  *
  * Description:
- * Enables (e.g. unmasks) the specified IRQ with an ACTIVE LOW bitmask. This 
- * function writes an 8-bit value the mask (master or slave) corresponding to
- * the integer input: irq_num.
+ * Enables (e.g. unmasks) the specified IRQ, at the I/O APIC once it has
+ * taken over (see ioapic_init), at the 8259s otherwise. The 8259 masks 
+ * are ACTIVE LOW, so the IRQ's bit is cleared in the mask of the PIC it is
+ * on, which is then written out.
  *
- * Inputs: none
+ * Inputs: irq_num - the IRQ
  *
  * Retvals: none
  */
 void enable_irq(uint32_t irq_num)
 {
-
 	/* Return if irq_num is invalid */
-	if ((irq_num > 15) || (irq_num < 0)) {
+	if (irq_num > 15) {
 		return;
 	}
 
-	/* initially mask = 11111110 */
-	uint8_t mask = 0xFE;
-
-	/* Here we shift the '0' in "mask" to correspond to the proper irq. */
+	if (ioapic_active) {
+		ioapic_enable_irq(irq_num);
+		return;
+	}
 
 	/**** If irq_num is in master bounds: ****/
-	if ((irq_num >= 0) && (irq_num <= 7)) {
-		/* left circular shift by irq_num */
-		int b;
-		for (b = 0; b < irq_num; b++) {
-			mask = (mask << 1) + 1;
-		}
-
-		master_mask = master_mask & mask;
+	if (irq_num <= 7) {
+		master_mask &= ~(1 << irq_num);
 		outb( master_mask, MASTER_8259_PORT + 1 );
 		return;
 	}
 
 	/**** If irq_num is in slave bounds: ****/
-	if ((irq_num >= 8) && (irq_num <= 15)) {
-		irq_num -= 8; /* Get irq_num into 0-7 range */
-		/* left circular shift by irq_num */
-		int b;
-		for (b = 0; b < irq_num; b++) {
-			mask = (mask << 1) + 1;
-		}
-
-		slave_mask = slave_mask & mask;
-		outb( slave_mask, SLAVE_8259_PORT + 1 );
-		return;
-	}
+	slave_mask &= ~(1 << (irq_num - 8));
+	outb( slave_mask, SLAVE_8259_PORT + 1 );
 }
 
 /*
  * disable_irq()
  *
  * Description:
- * Disable (e.g. masks) the specified IRQ with an INACTIVE HIGH bitmask. This 
- * function writes an 8-bit value the mask (master or slave) corresponding to
- * the integer input: irq_num.
+ * Disables (e.g. masks) the specified IRQ, at the I/O APIC once it has
+ * taken over, at the 8259s otherwise, by setting its bit in the mask of
+ * the PIC it is on.
  *
- * Inputs: none
+ * Inputs: irq_num - the IRQ
  *
  * Retvals: none
  */
 void disable_irq(uint32_t irq_num)
 {
 	/* Return if irq_num is invalid */
-	if ((irq_num > 15) || (irq_num < 0)) {
+	if (irq_num > 15) {
 		return;
 	}
 
-	/* initially mask = 00000001 */
-	uint8_t mask = 0x01;
-
-	/* Here we shift the '1' in "mask" to correspond to the proper irq. */
+	if (ioapic_active) {
+		ioapic_disable_irq(irq_num);
+		return;
+	}
 
 	/**** If irq_num is in master bounds: ****/
-	if ((irq_num >= 0) && (irq_num <= 7)) {
-		/* left circular shift by irq_num */
-		int b;
-		for (b = 0; b < irq_num; b++) {
-			mask = (mask << 1);
-		}
-
-		master_mask = master_mask | mask;
+	if (irq_num <= 7) {
+		master_mask |= (1 << irq_num);
 		outb( master_mask, MASTER_8259_PORT + 1 );
 		return;
 	}
 
 	/**** If irq_num is in slave bounds: ****/
-	if ((irq_num >= 8) && (irq_num <= 15)) {
-		irq_num -= 8; /* Get irq_num into 0-7 range */
-		/* left circular shift by irq_num */
-		int b;
-		for (b = 0; b < irq_num; b++) {
-			mask = (mask << 1);
-		}
-
-		slave_mask = slave_mask | mask;
-		outb( slave_mask, SLAVE_8259_PORT + 1 );
-		return;
-	}
+	slave_mask |= (1 << (irq_num - 8));
+	outb( slave_mask, SLAVE_8259_PORT + 1 );
 }
 
 /*
  * send_eoi()
  *
  * Description:
- * Send end-of-interrupt signal for the specified IRQ
+ * Send end-of-interrupt signal for the specified IRQ: a single write to
+ * the local APIC once the I/O APIC has taken over, port writes to the 
+ * 8259s otherwise.
  *
- * Inputs: none
+ * Inputs: irq_num - the IRQ
  *
  * Retvals: none
  */
 void send_eoi(uint32_t irq_num)
 {
+	if (ioapic_active) {
+		apic_eoi();
+		return;
+	}
+
 	/**** If irq_num is in master bounds: ****/
 
-	if ((irq_num >= 0) && (irq_num <= 7)) {
+	if (irq_num <= 7) {
 		outb( EOI | irq_num, MASTER_8259_PORT);
 	}
 
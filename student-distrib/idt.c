@@ -39,7 +39,6 @@ EXCEPTION(exception_TS,"Invalid TSS Exception!");
 EXCEPTION(exception_NP,"Segment Not Present!");
 EXCEPTION(exception_SS,"Stack Fault Exception!");
 EXCEPTION(exception_GP,"General Protection Exception!");
-EXCEPTION(exception_PF,"Page Fault Exception!");
 EXCEPTION(exception_MF,"Floating Point Exception");
 EXCEPTION(exception_AC,"Alignment Check Exception!");
 EXCEPTION(exception_MC,"Machine Check Exception!");
@@ -124,7 +123,13 @@ void init_idt () {
 	SET_IDT_ENTRY(idt[11], exception_NP);
 	SET_IDT_ENTRY(idt[12], exception_SS);
 	SET_IDT_ENTRY(idt[13], exception_GP);
-	SET_IDT_ENTRY(idt[14], exception_PF);	
+	SET_IDT_ENTRY(idt[14], page_fault_handler);
+
+	/* 
+	 * Page faults load programs, so they go through an interrupt gate: the
+	 * handler has to read CR2 before another fault can overwrite it.
+	 */
+	idt[14].reserved3 = 0x0;
 	SET_IDT_ENTRY(idt[16], exception_MF);
 	SET_IDT_ENTRY(idt[17], exception_AC);
 	SET_IDT_ENTRY(idt[18], exception_MC);
@@ -142,4 +147,19 @@ void init_idt () {
 	/* System Call interrupt routed to asm wrapper named: syscall_handler */
 	SET_IDT_ENTRY(idt[SYSCALL_INT], syscall_handler);
 
+	/* The kernel's own yield (int 0x81) routed to asm wrapper named: yield_handler */
+	SET_IDT_ENTRY(idt[YIELD_INT], yield_handler);
+
+	/* Local APIC timer interrupt routed to asm wrapper named: apic_timer_handler */
+	SET_IDT_ENTRY(idt[APIC_TIMER_INT], apic_timer_handler);
+	SET_IDT_ENTRY(idt[APIC_SPURIOUS_INT], apic_spurious_handler);
+
+	/* The same device interrupts, as the I/O APIC delivers them (see ioapic.c) */
+	SET_IDT_ENTRY(idt[PIT_APIC_INT], pit_handler);
+	SET_IDT_ENTRY(idt[KEYBOARD_APIC_INT], keyboard_handler);
+	SET_IDT_ENTRY(idt[RTC_APIC_INT], clock_handler);
+
+	/* Reschedule interrupt from another processor routed to asm wrapper named: resched_handler */
+	SET_IDT_ENTRY(idt[RESCHED_INT], resched_handler);
+
 }
@@ -10,6 +10,19 @@
 #define KEYBOARD_INT	0x21
 #define RTC_INT			0x28
 #define SYSCALL_INT		0x80
+#define YIELD_INT		0x81
+#define APIC_TIMER_INT	0x40
+#define RESCHED_INT		0x41
+#define APIC_SPURIOUS_INT	0xFF
+
+/* 
+ * The device interrupts' vectors when the I/O APIC delivers them. Pending
+ * interrupts are served highest vector / 16 first, so these also set the
+ * devices' priorities: the PIT first, then the keyboard, then the RTC.
+ */
+#define PIT_APIC_INT		0x70
+#define KEYBOARD_APIC_INT	0x60
+#define RTC_APIC_INT		0x50
 
 
 
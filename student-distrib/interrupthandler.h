@@ -16,8 +16,28 @@
 #define SYS_VIDMAP  8
 #define SYS_SET_HANDLER  9
 #define SYS_SIGRETURN  10
+#define SYS_MMAP    11
+#define SYS_SETPRIORITY  12
+#define SYS_SET_PERIODIC 13
+#define SYS_GET_RT_STATS 14
+#define SYS_SLEEP   15
+#define SYS_ALARM   16
+#define SYS_PAUSE   17
+#define SYS_CLOCK_GETTIME 18
 
+/* The highest system call number in syscall_jumptable. */
+#define SYS_LAST    SYS_CLOCK_GETTIME
 
+/* 
+ * The frame switch_to leaves on a stack it switches away from: EDI, ESI,
+ * EBX and EBP, then the return address (SWITCH_FRAME_RET words up).
+ */
+#define SWITCH_FRAME_SIZE 20
+#define SWITCH_FRAME_RET  4
+
+
+
+#ifndef ASM
 
 /* Keyboard interrupt asm wrapper */
 extern void keyboard_handler();
@@ -28,15 +48,37 @@ extern void clock_handler();
 /* PIT interrupt asm wrapper */
 extern void pit_handler();
 
+/* Yield interrupt asm wrapper */
+extern void yield_handler();
+
+/* Local APIC timer interrupt asm wrapper */
+extern void apic_timer_handler();
+
+/* Reschedule interrupt asm wrapper */
+extern void resched_handler();
+
+/* Spurious local APIC interrupt handler */
+extern void apic_spurious_handler();
+
+/* Page fault asm wrapper */
+extern void page_fault_handler();
+
 /* System Call interrupt asm wrapper */
 extern void syscall_handler();
 
+/* System Call SYSENTER asm wrapper */
+extern void sysenter_handler();
+
 /* System Call interrupt asm wrapper */
 extern void test_syscall(uint32_t syscallnum, uint32_t param1, uint32_t param2, uint32_t param3);
 
+/* Switches kernel stacks, saving the callee-saved registers. */
+extern void switch_to(uint32_t * prev_ksp, uint32_t next_ksp);
+
 /* Jumps to user space. */
 extern void to_the_user_space(int32_t newEIP);
 
+#endif /* ASM */
 
 
 #endif /* INTERRUPT_HANDLER_H*/
@@ -0,0 +1,203 @@
+/*************************************************/
+/* ioapic.c - Device interrupts through the      */
+/*            I/O APIC.                          */
+/*************************************************/
+#include "ioapic.h"
+#include "apic.h"
+#include "acpi.h"
+#include "idt.h"
+#include "lib.h"
+#include "rtc.h"
+#include "keyboard.h"
+#include "scheduler.h"
+
+
+
+/* The I/O APIC's registers, and whether it is in use. */
+uint32_t ioapic_base;
+uint32_t ioapic_active;
+
+/* The number of redirection entries it has. */
+uint32_t ioapic_entries;
+
+/*
+ * The vector each ISA IRQ is delivered on (0 for IRQs nothing handles).
+ * The local APIC serves pending interrupts highest priority class
+ * (vector / 16) first, so these vectors are the IRQs' priorities; change
+ * them in idt.h.
+ */
+static const uint8_t irq_vectors[NUM_ISA_IRQS] = {
+	[PIT_IRQ]      = PIT_APIC_INT,
+	[KEYBOARD_IRQ] = KEYBOARD_APIC_INT,
+	[RTC_IRQ]      = RTC_APIC_INT,
+};
+
+
+
+/*
+ * ioapic_read()
+ *
+ * Description:
+ * Reads an I/O APIC register.
+ *
+ * Inputs: reg - the index of the register
+ * Retvals: its value
+ */
+static uint32_t ioapic_read(uint32_t reg)
+{
+	*(volatile uint32_t *)(ioapic_base + IOAPIC_REGSEL) = reg;
+	return *(volatile uint32_t *)(ioapic_base + IOAPIC_WINDOW);
+}
+
+/*
+ * ioapic_write()
+ *
+ * Description:
+ * Writes an I/O APIC register.
+ *
+ * Inputs:
+ * reg: the index of the register
+ * value: what to write
+ * Retvals: none
+ */
+static void ioapic_write(uint32_t reg, uint32_t value)
+{
+	*(volatile uint32_t *)(ioapic_base + IOAPIC_REGSEL) = reg;
+	*(volatile uint32_t *)(ioapic_base + IOAPIC_WINDOW) = value;
+}
+
+/*
+ * ioapic_entry()
+ *
+ * Description:
+ * Finds the redirection entry an ISA IRQ arrives on, following the MADT's
+ * interrupt source overrides (the PIT's IRQ 0 usually arrives on 2).
+ *
+ * Inputs: irq_num - the ISA IRQ
+ * Retvals:
+ * -1: the I/O APIC has no entry for it
+ * the entry otherwise
+ */
+static int32_t ioapic_entry(uint32_t irq_num)
+{
+	/* Local variables. */
+	acpi_info_t * info = acpi_get_info();
+	uint32_t gsi;
+
+	if( irq_num >= NUM_ISA_IRQS )
+	{
+		return -1;
+	}
+
+	gsi = info->isa_gsi[irq_num];
+	if( gsi < info->ioapic_gsi_base || gsi - info->ioapic_gsi_base >= ioapic_entries )
+	{
+		return -1;
+	}
+
+	return gsi - info->ioapic_gsi_base;
+}
+
+/*
+ * ioapic_init()
+ *
+ * Description:
+ * Takes over the device interrupts from the 8259s, when the MADT lists an
+ * I/O APIC in the mapped device area and the local APIC is on: every
+ * redirection entry is masked, and so are both 8259s and the local APIC's
+ * LINT0 they deliver through. enable_irq, disable_irq and send_eoi go
+ * through the I/O APIC from then on, and EOIs become a single write to
+ * the local APIC. Must run after acpi_init and a successful apic_init,
+ * and before any IRQ is enabled.
+ *
+ * Inputs: none
+ * Retvals:
+ * -1: the 8259s stay in use
+ * 0: success
+ */
+int32_t ioapic_init(void)
+{
+	/* Local variables. */
+	acpi_info_t * info = acpi_get_info();
+	uint32_t i;
+
+	if( info->ioapic_addr < DEVICE_MAP_BASE )
+	{
+		return -1;
+	}
+
+	ioapic_base = info->ioapic_addr;
+	ioapic_entries = ((ioapic_read(IOAPIC_VERSION) >> IOAPIC_MAX_ENTRY_SHIFT) & 0xFF) + 1;
+
+	for( i = 0; i < ioapic_entries; i++ )
+	{
+		ioapic_write(IOAPIC_REDIRECTION(i) + 1, 0);
+		ioapic_write(IOAPIC_REDIRECTION(i), IOAPIC_MASKED);
+	}
+
+	outb(I8259_MASK_ALL, MASTER_8259_DATA);
+	outb(I8259_MASK_ALL, SLAVE_8259_DATA);
+	apic_disable_extint();
+
+	ioapic_active = 1;
+	return 0;
+}
+
+/*
+ * ioapic_enable_irq()
+ *
+ * Description:
+ * Routes an ISA IRQ to its vector (see irq_vectors) on the processor
+ * running this, with the polarity and trigger mode the MADT gives it, and
+ * unmasks it.
+ *
+ * Inputs: irq_num - the ISA IRQ
+ * Retvals: none
+ */
+void ioapic_enable_irq(uint32_t irq_num)
+{
+	/* Local variables. */
+	acpi_info_t * info = acpi_get_info();
+	int32_t entry = ioapic_entry(irq_num);
+	uint32_t low;
+
+	if( entry < 0 || irq_vectors[irq_num] == 0 )
+	{
+		return;
+	}
+
+	low = irq_vectors[irq_num];
+	if( (info->isa_flags[irq_num] & MADT_POLARITY_MASK) == MADT_ACTIVE_LOW )
+	{
+		low |= IOAPIC_ACTIVE_LOW;
+	}
+	if( (info->isa_flags[irq_num] & MADT_TRIGGER_MASK) == MADT_LEVEL )
+	{
+		low |= IOAPIC_LEVEL;
+	}
+
+	ioapic_write(IOAPIC_REDIRECTION(entry) + 1, apic_id() << IOAPIC_DEST_SHIFT);
+	ioapic_write(IOAPIC_REDIRECTION(entry), low);
+}
+
+/*
+ * ioapic_disable_irq()
+ *
+ * Description:
+ * Masks an ISA IRQ at the I/O APIC.
+ *
+ * Inputs: irq_num - the ISA IRQ
+ * Retvals: none
+ */
+void ioapic_disable_irq(uint32_t irq_num)
+{
+	/* Local variables. */
+	int32_t entry = ioapic_entry(irq_num);
+
+	if( entry < 0 )
+	{
+		return;
+	}
+
+	ioapic_write(IOAPIC_REDIRECTION(entry), ioapic_read(IOAPIC_REDIRECTION(entry)) | IOAPIC_MASKED);
+}
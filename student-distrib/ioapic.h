@@ -0,0 +1,54 @@
+/*************************************************/
+/* ioapic.h - Device interrupts through the      */
+/*            I/O APIC.                          */
+/*************************************************/
+#ifndef IOAPIC_H
+#define IOAPIC_H
+
+
+
+#include "types.h"
+
+
+
+/* I/O APIC registers: an index, and a window onto the indexed register. */
+#define IOAPIC_REGSEL         0x00
+#define IOAPIC_WINDOW         0x10
+#define IOAPIC_VERSION        0x01
+#define IOAPIC_REDIRECTION(n) (0x10 + 2 * (n))
+#define IOAPIC_MAX_ENTRY_SHIFT 16
+
+/* Redirection entry bits (the low half; the high half is the destination). */
+#define IOAPIC_MASKED         0x10000
+#define IOAPIC_LEVEL          0x08000
+#define IOAPIC_ACTIVE_LOW     0x02000
+#define IOAPIC_DEST_SHIFT     24
+
+/* Polarity and trigger mode of an interrupt source override in the MADT. */
+#define MADT_POLARITY_MASK    0x3
+#define MADT_ACTIVE_LOW       0x3
+#define MADT_TRIGGER_MASK     0xC
+#define MADT_LEVEL            0xC
+
+/* The 8259 data ports, where writing 0xFF masks every IRQ. */
+#define MASTER_8259_DATA      0x21
+#define SLAVE_8259_DATA       0xA1
+#define I8259_MASK_ALL        0xFF
+
+
+
+/* Set once the I/O APIC delivers the device interrupts instead of the 8259s. */
+extern uint32_t ioapic_active;
+
+/* Takes over the device interrupts from the 8259s, if there is an I/O APIC. */
+int32_t ioapic_init(void);
+
+/* Unmasks an ISA IRQ at the I/O APIC. */
+void ioapic_enable_irq(uint32_t irq_num);
+
+/* Masks an ISA IRQ at the I/O APIC. */
+void ioapic_disable_irq(uint32_t irq_num);
+
+
+
+#endif /* IOAPIC_H */
@@ -14,6 +14,14 @@
 #include "files.h"
 #include "syscalls.h"
 #include "scheduler.h"
+#include "frames.h"
+#include "slab.h"
+#include "process.h"
+#include "apic.h"
+#include "acpi.h"
+#include "smp.h"
+#include "ioapic.h"
+#include "ktimer.h"
 
 
 /* Macros. */
@@ -159,19 +167,57 @@ entry (unsigned long magic, unsigned long addr)
 	/* Initialize devices, memory, filesystem, enable device interrupts on the
 	 * PIC, any other initialization stuff... */
 
+	/** Initialize the physical frame allocator from the memory map **/
+	frames_init(mbi);
+
 	/** Initialize virtual memory **/
 	init_paging();
 	
+	/** Initialize the kernel object caches **/
+	slab_init();
+	process_init();
+	ktimer_init();
+	fd_init();
+	
 	/** Initialize the filesystem **/
 	module_t* module = (module_t*)mbi->mods_addr;
 	fs_open( module->mod_start, module->mod_end );
 
+#ifdef BENCHMARK
+	/** Run the boot-time microbenchmarks **/
+	files_bench();
+	sched_bench();
+	paging_bench();
+	ktimer_bench();
+#endif
+
+	/** Find the processors and APICs **/
+	acpi_init();
+
+	/** Init the local APIC, and route device interrupts through the I/O APIC, when there are both **/
+	if( 0 == apic_init() )
+	{
+		ioapic_init();
+	}
+
 	/** Init the RTC **/
 	rtc_init();
 
-	/** Init the PIT (Programmable Interval Timer) **/
+	/** Init the PIT (Programmable Interval Timer) and the scheduler's clock **/
 	pit_init();
 
+	/* 
+	 * The boot processor holds the kernel lock from here until the first
+	 * shell starts, so the other processors wait for it.
+	 */
+	kernel_enter();
+
+	/** Start the other processors **/
+	smp_init();
+	
+	/** Take system calls through SYSENTER too, where the processor has it **/
+	sysenter_init();
+
 	/** Initialize keyboard **/
 	keyboard_open();
 	
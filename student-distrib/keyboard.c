@@ -5,6 +5,8 @@
 #include "keyboard.h"
 #include "i8259.h"
 #include "syscalls.h"
+#include "scheduler.h"
+#include "slab.h"
 
 
 
@@ -145,6 +147,21 @@ unsigned char keyboardflag[3];
  * by foribing terminal_read until ready (upon a MAKE_ENTER scancode). */
 uint32_t allow_terminal_read[3];
 
+/* The processes blocked in terminal_read on each tty, until ENTER is pressed. */
+wait_queue_t terminal_wait[3];
+
+/* When ENTER was last pressed on each tty (0 once a reader has taken it). */
+uint64_t enter_time[3];
+
+/* 
+ * The latency from ENTER to the reader running again, in TSC cycles, since
+ * the statistics were last printed. Under load a single wait can take
+ * seconds, so the cycles are counted in 64 bits.
+ */
+uint32_t input_latency_count;
+uint64_t input_latency_cycles;
+uint64_t input_latency_max_cycles;
+
 
 
 /* 
@@ -154,20 +171,39 @@ uint32_t allow_terminal_read[3];
  * Implements read syscall specific to the terminal. 
  *
  * Inputs:
+ * fd: the open stdin file (unused)
  * buf: buf to read the command buffer into
  * nbytes: number of bytes to read
  *
  * Outputs:
  * countread: the number of bytes read
  */
-int32_t terminal_read(unsigned char * buf, int32_t nbytes) {
+int32_t terminal_read(struct file_descriptor_t * fd, void * buf, int32_t nbytes) {
 	int i;
 	int countread = 0;
+	uint32_t tty = get_tty_number();
+	uint32_t flags;
+	uint64_t cycles;
 	
-	set_command_location(get_tty_number());
+	set_command_location(tty);
 
-	/* Spin until allow_terminal_read = 1 (we allow it to be read). */
-	while(!allow_terminal_read[get_tty_number()]);
+	/* Sleep until allow_terminal_read = 1 (we allow it to be read). */
+	cli_and_save(flags);
+	while(!allow_terminal_read[tty]) {
+		sleep_on(&terminal_wait[tty]);
+	}
+	
+	/* Account for how long it took from ENTER to get here. */
+	if (enter_time[tty] != 0) {
+		cycles = rdtsc() - enter_time[tty];
+		enter_time[tty] = 0;
+		input_latency_count++;
+		input_latency_cycles += cycles;
+		if (cycles > input_latency_max_cycles) {
+			input_latency_max_cycles = cycles;
+		}
+	}
+	restore_flags(flags);
 
 	/* We can only get here if we are the active terminal and the user
 	 * presses ENTER.
@@ -176,7 +212,7 @@ int32_t terminal_read(unsigned char * buf, int32_t nbytes) {
 
 	/* Iterate through nbytes reading (putting) the command buffer into buf. */
 	for (i = 0; i < nbytes; i++) {
-		buf[i] = command_buffer[active_terminal][i];
+		((unsigned char *)buf)[i] = command_buffer[active_terminal][i];
 		command_buffer[active_terminal][i] = NULL;
 		countread++;
 	}
@@ -197,13 +233,14 @@ int32_t terminal_read(unsigned char * buf, int32_t nbytes) {
  * "putc" and returns the number of bytes (or characters) printed.
  *
  * Inputs:
+ * fd: the open stdout file (unused)
  * buf: input buffer
  * nbytes: number of bytes to print from buffer
  *
  * Outputs:
  * successputs: the number of bytes printed
  */
-int32_t terminal_write(const unsigned char * buf, int32_t nbytes)
+int32_t terminal_write(struct file_descriptor_t * fd, const void * buf, int32_t nbytes)
 {
 
 	int i;
@@ -215,7 +252,7 @@ int32_t terminal_write(const unsigned char * buf, int32_t nbytes)
 	for (i = 0; i < nbytes; i++) {
 
 		/* Print a char from the buffer. */
-		putc(buf[i], get_tty_number());
+		putc(((const unsigned char *)buf)[i], get_tty_number());
 
 		/* Increment the number of bytes printed. */
 		successputs++;
@@ -345,7 +382,9 @@ void printthebuffer(void) {
  * This runs for every keypress. It handles the input based on its scancode.
  * Regular characters are placed into the command buffer. Other key inputs such
  * as backspace, delete, enter, ctrl, alt, and arrow keys perform their
- * respective tasks.
+ * respective tasks. CTRL + S prints the scheduler's statistics, and
+ * CTRL + K how long readers took to run after ENTER, and CTRL + M the
+ * kernel object caches.
  *
  * Inputs:
  * scancode: byte of data retrieved from keyboard
@@ -379,8 +418,10 @@ void process_keyboard_input(uint8_t scancode)
 
 	} else if (scancode == MAKE_ENTER) {
 		
-		/* Remove the lock on terminal reading. */
+		/* Remove the lock on terminal reading, and wake up the reader. */
 		allow_terminal_read[active_terminal] = 1;
+		enter_time[active_terminal] = rdtsc();
+		wake_up(&terminal_wait[active_terminal]);
 
 	} else if (scancode == MAKE_BKSP) {
 
@@ -478,7 +519,7 @@ void process_keyboard_input(uint8_t scancode)
 
 		}
 
-	} else if (keyboardflag[active_terminal] & FLAG_CTRL) /* CTRL + L */ {
+	} else if (keyboardflag[active_terminal] & FLAG_CTRL) /* CTRL + key */ {
 
 		/* Implement screen clear with CTRL + L input. */
 		if (scancode == MAKE_L){
@@ -488,8 +529,18 @@ void process_keyboard_input(uint8_t scancode)
 			command_length[active_terminal] = 0;
 			cursor_x[active_terminal] = 0;
 			allow_terminal_read[active_terminal] = 1;
+			wake_up(&terminal_wait[active_terminal]);
 			clear_the_screen();
 			keyboardflag[active_terminal] &= ~FLAG_CTRL;
+		} else if (scancode == MAKE_S) {
+			/* Print the scheduler's statistics with CTRL + S. */
+			sched_print_stats();
+		} else if (scancode == MAKE_K) {
+			/* Print the ENTER to reader latency with CTRL + K. */
+			keyboard_print_latency();
+		} else if (scancode == MAKE_M) {
+			/* Print the kernel object caches with CTRL + M. */
+			slab_print_stats();
 		}
 
 	} else {
@@ -540,6 +591,9 @@ void keyboard_interruption() {
 	/* Send End-of-Interrupt */
 	send_eoi(KEYBOARD_IRQ);
 
+	/* Run the reader woken by ENTER right away. */
+	sched_preempt();
+
 	/* Unmask interrupts */
 	sti();
 
@@ -561,3 +615,59 @@ uint32_t get_active_terminal( void )
 {
 	return active_terminal;
 }
+
+/* 
+ * cycles_to_us()
+ *
+ * Description:
+ * Converts TSC cycles to microseconds, which fit in 32 bits where the
+ * cycles of a long wait do not.
+ *
+ * Inputs:
+ * cycles: the TSC cycles
+ *
+ * Outputs:
+ * the microseconds (0 before the TSC is calibrated)
+ */
+static uint32_t cycles_to_us( uint64_t cycles )
+{
+	if (tsc_per_ms == 0) {
+		return 0;
+	}
+
+	return (uint32_t)div64(cycles * 1000, tsc_per_ms);
+}
+
+/* 
+ * keyboard_print_latency()
+ *
+ * Description:
+ * Prints how long readers took to run after ENTER since the last call,
+ * in microseconds, then starts counting again. CTRL + K calls it, so it
+ * can be read while the system is under load.
+ *
+ * Inputs: none
+ *
+ * Outputs: none
+ */
+void keyboard_print_latency( void )
+{
+	uint64_t average = 0;
+	uint32_t flags;
+
+	cli_and_save(flags);
+
+	if (input_latency_count != 0) {
+		average = div64(input_latency_cycles, input_latency_count);
+	}
+
+	printf("keyboard: %u reads, %u us average, %u us max from ENTER to the reader\n",
+	       input_latency_count, cycles_to_us(average), 
+	       cycles_to_us(input_latency_max_cycles));
+
+	input_latency_count = 0;
+	input_latency_cycles = 0;
+	input_latency_max_cycles = 0;
+
+	restore_flags(flags);
+}
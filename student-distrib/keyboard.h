@@ -181,14 +181,16 @@
 
 
 
+struct file_descriptor_t;
+
 /* Called to initialize keyboard before using it. */
 void keyboard_open(void);
 
 /* Called to read from command buffer */
-int32_t terminal_read(unsigned char * buf, int32_t nbytes);
+int32_t terminal_read(struct file_descriptor_t * fd, void * buf, int32_t nbytes);
 
 /* Called to read from command buffer */
-int32_t terminal_write(const unsigned char * buf, int32_t nbytes);
+int32_t terminal_write(struct file_descriptor_t * fd, const void * buf, int32_t nbytes);
 
 /* Called to read from command buffer */
 void printthebuffer(void);
@@ -202,6 +204,9 @@ void keyboard_interruption(void);
 /* Returns active terminal */
 uint32_t get_active_terminal( void );
 
+/* Prints the latency from ENTER to the reader running. */
+void keyboard_print_latency( void );
+
 
 
 #endif /* KEYBOARD_H */
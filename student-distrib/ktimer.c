@@ -0,0 +1,501 @@
+/*************************************************/
+/* ktimer.c - The kernel's timers.               */
+/*************************************************/
+#include "ktimer.h"
+#include "lib.h"
+#include "slab.h"
+#include "scheduler.h"
+
+
+
+/*
+ * The timer wheel. Each slot holds a list of pending timers, and each
+ * level a bitmap of its slots that are not empty. A timer goes into the
+ * lowest level that reaches its expiry, and moves down a level (cascades)
+ * when the level above comes round to its slot, so adding and cancelling
+ * a timer are O(1), and nothing is done for a timer until it is due.
+ */
+ktimer_t * wheel[KTIMER_LEVELS][KTIMER_SLOTS];
+uint32_t wheel_bitmap[KTIMER_LEVELS];
+
+/* The next millisecond the wheel runs, and the number of pending timers. */
+uint32_t wheel_clock;
+uint32_t ktimer_count;
+
+/* The cache timers that outlive a system call are allocated from. */
+slab_cache_t ktimer_cache;
+
+
+
+/*
+ * ktimer_init()
+ *
+ * Description:
+ * Sets up the cache timers are allocated from. Must run after slab_init.
+ *
+ * Inputs: none
+ * Retvals: none
+ */
+void ktimer_init(void)
+{
+	slab_cache_init(&ktimer_cache, "ktimer", sizeof(ktimer_t));
+}
+
+/*
+ * ktimer_alloc()
+ *
+ * Description:
+ * Allocates a timer, which is not pending.
+ *
+ * Inputs: none
+ * Retvals:
+ * NULL: out of memory
+ * the timer otherwise
+ */
+ktimer_t * ktimer_alloc(void)
+{
+	/* Local variables. */
+	ktimer_t * timer = (ktimer_t *)slab_alloc(&ktimer_cache);
+
+	if( timer != NULL )
+	{
+		memset(timer, 0, sizeof(ktimer_t));
+	}
+
+	return timer;
+}
+
+/*
+ * ktimer_free()
+ *
+ * Description:
+ * Frees a timer from ktimer_alloc. It must not be pending.
+ *
+ * Inputs: timer - the timer
+ * Retvals: none
+ */
+void ktimer_free(ktimer_t * timer)
+{
+	slab_free(timer);
+}
+
+/*
+ * ktimer_setup()
+ *
+ * Description:
+ * Fills in what a timer calls when it expires. Timers on the stack must
+ * be cleared first; ktimer_alloc does that for the others.
+ *
+ * Inputs:
+ * timer: the timer, which must not be pending
+ * function: called when it expires
+ * data: for the function to use
+ * Retvals: none
+ */
+void ktimer_setup(ktimer_t * timer, ktimer_func_t function, void * data)
+{
+	timer->function = function;
+	timer->data = data;
+}
+
+/*
+ * wheel_insert()
+ *
+ * Description:
+ * Puts a timer in the slot its expiry falls in, relative to wheel_clock:
+ * level 0 if it is due within KTIMER_SLOTS milliseconds (or already
+ * overdue, in which case it goes in the slot run next), the next level
+ * if it is due within KTIMER_SLOTS times that, and so on. Timers beyond
+ * the last level wait at its far end.
+ *
+ * Inputs: timer - the timer, which must not be pending
+ * Retvals: none
+ */
+static void wheel_insert(ktimer_t * timer)
+{
+	/* Local variables. */
+	uint32_t delta = timer->expires - wheel_clock;
+	uint32_t level;
+	uint32_t slot;
+	ktimer_t ** head;
+
+	if( (int32_t)delta < 0 )
+	{
+		delta = 0;
+	}
+	if( delta >= (1 << (KTIMER_LEVELS * KTIMER_SLOT_BITS)) )
+	{
+		delta = (1 << (KTIMER_LEVELS * KTIMER_SLOT_BITS)) - 1;
+	}
+
+	for( level = 0; level < KTIMER_LEVELS - 1; level++ )
+	{
+		if( delta < (1 << ((level + 1) * KTIMER_SLOT_BITS)) )
+		{
+			break;
+		}
+	}
+
+	slot = ((wheel_clock + delta) >> (level * KTIMER_SLOT_BITS)) & KTIMER_SLOT_MASK;
+	head = &wheel[level][slot];
+
+	timer->level = level;
+	timer->slot = slot;
+	timer->prev = NULL;
+	timer->next = *head;
+	if( *head != NULL )
+	{
+		(*head)->prev = timer;
+	}
+	*head = timer;
+
+	wheel_bitmap[level] |= (1 << slot);
+	timer->pending = 1;
+	ktimer_count++;
+}
+
+/*
+ * wheel_remove()
+ *
+ * Description:
+ * Takes a timer out of its slot.
+ *
+ * Inputs: timer - the timer, which must be pending
+ * Retvals: none
+ */
+static void wheel_remove(ktimer_t * timer)
+{
+	/* Local variables. */
+	ktimer_t ** head = &wheel[timer->level][timer->slot];
+
+	if( timer->prev != NULL )
+	{
+		timer->prev->next = timer->next;
+	}
+	else
+	{
+		*head = timer->next;
+	}
+	if( timer->next != NULL )
+	{
+		timer->next->prev = timer->prev;
+	}
+
+	if( *head == NULL )
+	{
+		wheel_bitmap[timer->level] &= ~(1 << timer->slot);
+	}
+
+	timer->next = NULL;
+	timer->prev = NULL;
+	timer->pending = 0;
+	ktimer_count--;
+}
+
+/*
+ * ktimer_add()
+ *
+ * Description:
+ * Starts a timer that expires at the given millisecond (see
+ * sched_now_ms), and then every 'period' milliseconds after that if the
+ * timer has a period. A timer that is already pending is moved. The boot
+ * processor's timer is brought forward if it would otherwise interrupt
+ * too late for the new timer.
+ *
+ * Inputs:
+ * timer: the timer
+ * expires: when it is due, in milliseconds since boot
+ * Retvals: none
+ */
+void ktimer_add(ktimer_t * timer, uint32_t expires)
+{
+	/* Local variables. */
+	uint32_t flags;
+
+	cli_and_save(flags);
+
+	if( timer->pending )
+	{
+		wheel_remove(timer);
+	}
+
+	timer->expires = expires;
+	wheel_insert(timer);
+	sched_ktimer_added();
+
+	restore_flags(flags);
+}
+
+/*
+ * ktimer_cancel()
+ *
+ * Description:
+ * Stops a timer, if it is pending. Its function is not called.
+ *
+ * Inputs: timer - the timer
+ * Retvals: none
+ */
+void ktimer_cancel(ktimer_t * timer)
+{
+	/* Local variables. */
+	uint32_t flags;
+
+	cli_and_save(flags);
+
+	if( timer->pending )
+	{
+		wheel_remove(timer);
+	}
+
+	restore_flags(flags);
+}
+
+/*
+ * first_slot()
+ *
+ * Description:
+ * Counts the slots from 'from', going round the level, to the first one
+ * with timers in it.
+ *
+ * Inputs:
+ * bitmap: the level's bitmap, which must not be 0
+ * from: the slot to start from
+ * Retvals: 0 if 'from' has timers, up to KTIMER_SLOTS - 1 otherwise
+ */
+static uint32_t first_slot(uint32_t bitmap, uint32_t from)
+{
+	/* Local variables. */
+	uint32_t rotated;
+	uint32_t distance;
+
+	rotated = (bitmap >> from) | (bitmap << ((KTIMER_SLOTS - from) & KTIMER_SLOT_MASK));
+	asm volatile("bsfl %1, %0":"=r"(distance):"rm"(rotated));
+	return distance;
+}
+
+/*
+ * ktimer_next()
+ *
+ * Description:
+ * Finds the next millisecond the wheel has anything to do: a level 0 slot
+ * to run, or a slot of a higher level to cascade. The timers pending in
+ * the higher levels are not looked at, so this is O(KTIMER_LEVELS)
+ * however many there are. A higher level's slot is cascaded when the
+ * clock reaches its start; the slot the clock is in is due now if the
+ * clock is at its start, and was already cascaded otherwise, so whatever
+ * is in it now is a whole turn of the level away.
+ *
+ * Inputs: when - filled in with the millisecond
+ * Retvals:
+ * -1: no timer is pending
+ * 0: success
+ */
+int32_t ktimer_next(uint32_t * when)
+{
+	/* Local variables. */
+	uint32_t level;
+	uint32_t shift;
+	uint32_t current;
+	uint32_t distance;
+	uint32_t next;
+	uint32_t found = 0;
+
+	if( ktimer_count == 0 )
+	{
+		return -1;
+	}
+
+	for( level = 0; level < KTIMER_LEVELS; level++ )
+	{
+		if( wheel_bitmap[level] == 0 )
+		{
+			continue;
+		}
+
+		shift = level * KTIMER_SLOT_BITS;
+		current = (wheel_clock >> shift) & KTIMER_SLOT_MASK;
+
+		if( (wheel_clock & ((1 << shift) - 1)) == 0 )
+		{
+			distance = first_slot(wheel_bitmap[level], current);
+		}
+		else
+		{
+			distance = first_slot(wheel_bitmap[level], (current + 1) & KTIMER_SLOT_MASK) + 1;
+		}
+
+		next = ((wheel_clock >> shift) + distance) << shift;
+		if( !found || (int32_t)(next - *when) < 0 )
+		{
+			*when = next;
+			found = 1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * wheel_step()
+ *
+ * Description:
+ * Does the work of the millisecond wheel_clock: cascades the slots of the
+ * higher levels that start here, then calls every timer of the level 0
+ * slot, one at a time, so a function may add or cancel any timer. A
+ * periodic timer is added again for its next period still to come before
+ * its function is called.
+ *
+ * Inputs: none
+ * Retvals: none
+ */
+static void wheel_step(void)
+{
+	/* Local variables. */
+	uint32_t level;
+	uint32_t slot;
+	uint32_t count;
+	ktimer_t * timer;
+
+	for( level = 1; level < KTIMER_LEVELS; level++ )
+	{
+		if( (wheel_clock & ((1 << (level * KTIMER_SLOT_BITS)) - 1)) != 0 )
+		{
+			break;
+		}
+
+		slot = (wheel_clock >> (level * KTIMER_SLOT_BITS)) & KTIMER_SLOT_MASK;
+		while( (timer = wheel[level][slot]) != NULL )
+		{
+			wheel_remove(timer);
+			wheel_insert(timer);
+		}
+	}
+
+	slot = wheel_clock & KTIMER_SLOT_MASK;
+	while( (timer = wheel[0][slot]) != NULL )
+	{
+		wheel_remove(timer);
+
+		count = 1;
+		if( timer->period != 0 )
+		{
+			count += (wheel_clock - timer->expires) / timer->period;
+			timer->expires += count * timer->period;
+			wheel_insert(timer);
+		}
+
+		timer->function(timer, count);
+	}
+
+	wheel_clock++;
+}
+
+/*
+ * ktimer_run()
+ *
+ * Description:
+ * Runs every timer due up to the millisecond 'now'. The wheel's clock
+ * jumps from one thing to do to the next (see ktimer_next), instead of
+ * stepping through every millisecond in between. Called from the timer
+ * interrupt, with interrupts masked.
+ *
+ * Inputs: now - the current millisecond (see sched_now_ms)
+ * Retvals: none
+ */
+void ktimer_run(uint32_t now)
+{
+	/* Local variables. */
+	uint32_t next;
+
+	while( (int32_t)(now - wheel_clock) >= 0 )
+	{
+		if( 0 != ktimer_next(&next) || (int32_t)(next - now) > 0 )
+		{
+			wheel_clock = now + 1;
+			break;
+		}
+
+		wheel_clock = next;
+		wheel_step();
+	}
+}
+
+#ifdef BENCHMARK
+/* The timers ktimer_bench adds, and how many of them expired. */
+static ktimer_t bench_timers[KTIMER_BENCH_TIMERS];
+static uint32_t bench_expired;
+
+/*
+ * ktimer_bench_expired()
+ *
+ * Description:
+ * What the timers of ktimer_bench call: counts them.
+ *
+ * Inputs: timer, count - unused
+ * Retvals: none
+ */
+static void ktimer_bench_expired(ktimer_t * timer, uint32_t count)
+{
+	bench_expired++;
+}
+
+/*
+ * ktimer_bench()
+ *
+ * Description:
+ * Microbenchmark for the timer wheel. Adds KTIMER_BENCH_TIMERS timers,
+ * KTIMER_BENCH_SPACING milliseconds apart, then times finding the next
+ * event with all of them pending, running the wheel over the first
+ * second, and cancelling what is left, and prints the average cost of
+ * each operation in cycles. Must run before pit_init, while the wheel
+ * is empty; it is left empty, at millisecond 0, again.
+ *
+ * Inputs: none
+ * Retvals: none
+ */
+void ktimer_bench(void)
+{
+	/* Local variables. */
+	uint64_t start;
+	uint32_t add, next, run, cancel;
+	uint32_t when;
+	uint32_t i;
+
+	memset(bench_timers, 0, sizeof(bench_timers));
+	bench_expired = 0;
+
+	start = rdtsc();
+	for( i = 0; i < KTIMER_BENCH_TIMERS; i++ )
+	{
+		ktimer_setup(&bench_timers[i], ktimer_bench_expired, NULL);
+		ktimer_add(&bench_timers[i], (i + 1) * KTIMER_BENCH_SPACING);
+	}
+	add = (uint32_t)(rdtsc() - start) / KTIMER_BENCH_TIMERS;
+
+	start = rdtsc();
+	for( i = 0; i < KTIMER_BENCH_TIMERS; i++ )
+	{
+		ktimer_next(&when);
+	}
+	next = (uint32_t)(rdtsc() - start) / KTIMER_BENCH_TIMERS;
+
+	start = rdtsc();
+	for( i = 1; i <= 1000; i++ )
+	{
+		ktimer_run(i);
+	}
+	run = (uint32_t)(rdtsc() - start) / 1000;
+
+	start = rdtsc();
+	for( i = 0; i < KTIMER_BENCH_TIMERS; i++ )
+	{
+		ktimer_cancel(&bench_timers[i]);
+	}
+	cancel = (uint32_t)(rdtsc() - start) / KTIMER_BENCH_TIMERS;
+
+	wheel_clock = 0;
+
+	printf("ktimer (cycles): add %u, next %u, run %u/ms (%u expired), cancel %u, %u pending\n",
+	       add, next, run, bench_expired, cancel, KTIMER_BENCH_TIMERS);
+}
+#endif /* BENCHMARK */
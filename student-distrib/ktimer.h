@@ -0,0 +1,101 @@
+/*************************************************/
+/* ktimer.h - The kernel's timers.               */
+/*************************************************/
+#ifndef KTIMER_H
+#define KTIMER_H
+
+
+
+#include "types.h"
+
+
+
+/*
+ * The timer wheel: KTIMER_LEVELS levels of KTIMER_SLOTS slots each, every
+ * level's slots KTIMER_SLOTS times as long as the level below's. Level 0
+ * has one slot per millisecond, so the wheel covers 2^25ms (over 9 hours);
+ * timers further away wait in the last level and are placed again when
+ * they come around.
+ */
+#define KTIMER_SLOT_BITS     5
+#define KTIMER_SLOTS         (1 << KTIMER_SLOT_BITS)
+#define KTIMER_SLOT_MASK     (KTIMER_SLOTS - 1)
+#define KTIMER_LEVELS        5
+
+/*
+ * The furthest ahead, in milliseconds, a timer may be set. Expiries are
+ * compared modulo 2^32, so they must stay well within 2^31ms of now.
+ */
+#define KTIMER_MAX_MS        (1 << 30)
+
+/* How many timers ktimer_bench keeps pending, and how far apart they expire. */
+#define KTIMER_BENCH_TIMERS  2048
+#define KTIMER_BENCH_SPACING 97
+
+
+
+struct ktimer_t;
+
+/*
+ * What a timer calls when it expires, with the number of its periods that
+ * have ended (1, unless some were missed).
+ */
+typedef void (*ktimer_func_t)(struct ktimer_t * timer, uint32_t count);
+
+/* Explanation:
+ * A timer. It sits in one slot of the timer wheel while it is pending,
+ * and is called from the timer interrupt, with interrupts masked and the
+ * kernel lock held, once its time comes.
+ *    next, prev -- Links in the list of its slot.
+ *    expires -- When it is due, in milliseconds since boot.
+ *    period -- For a periodic timer, the milliseconds between expiries;
+ *              0 for a timer that expires once.
+ *    level, slot -- Where it sits in the wheel.
+ *    pending -- Set while it sits in the wheel.
+ *    function -- Called when it expires.
+ *    data -- For the function to use.
+ */
+typedef struct ktimer_t {
+	struct ktimer_t * next;
+	struct ktimer_t * prev;
+	uint32_t expires;
+	uint32_t period;
+	uint32_t level;
+	uint32_t slot;
+	uint32_t pending;
+	ktimer_func_t function;
+	void * data;
+} ktimer_t;
+
+
+
+/* Sets up the cache timers are allocated from. */
+void ktimer_init(void);
+
+/* Allocates a timer. */
+ktimer_t * ktimer_alloc(void);
+
+/* Frees a timer, which must not be pending. */
+void ktimer_free(ktimer_t * timer);
+
+/* Fills in a timer's function and data. */
+void ktimer_setup(ktimer_t * timer, ktimer_func_t function, void * data);
+
+/* Starts a timer that expires at the given millisecond. */
+void ktimer_add(ktimer_t * timer, uint32_t expires);
+
+/* Stops a timer, if it is pending. */
+void ktimer_cancel(ktimer_t * timer);
+
+/* Runs every timer due up to the given millisecond. */
+void ktimer_run(uint32_t now);
+
+/* Finds when the wheel next needs to run. */
+int32_t ktimer_next(uint32_t * when);
+
+/* Measures the cost of the timer operations with many timers pending. */
+void ktimer_bench(void);
+
+
+
+#endif /* KTIMER_H */
@@ -167,4 +167,70 @@ do {                                    \
 			);                      \
 } while(0)
 
+/* Reads the 64-bit time stamp counter (cycles since reset) */
+static inline uint64_t rdtsc(void)
+{
+	uint64_t val;
+	asm volatile("rdtsc"
+			: "=A"(val)
+			:
+			: "memory" );
+	return val;
+}
+
+/* Runs cpuid for a leaf, returning the four registers it fills in */
+static inline void cpuid(uint32_t leaf, uint32_t * eax, uint32_t * ebx,
+                         uint32_t * ecx, uint32_t * edx)
+{
+	asm volatile("cpuid"
+			: "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx)
+			: "a"(leaf), "c"(0) );
+}
+
+/* Reads a model specific register */
+static inline uint64_t rdmsr(uint32_t msr)
+{
+	uint64_t val;
+	asm volatile("rdmsr"
+			: "=A"(val)
+			: "c"(msr) );
+	return val;
+}
+
+/* Writes a model specific register */
+static inline void wrmsr(uint32_t msr, uint64_t val)
+{
+	asm volatile("wrmsr"
+			:
+			: "c"(msr), "A"(val)
+			: "memory" );
+}
+
+/* 
+ * Divides a 64-bit number by a 32-bit one with a single divl (there is no
+ * libgcc for the compiler to call). The quotient must fit in 32 bits.
+ */
+static inline uint32_t div64_32(uint64_t n, uint32_t d)
+{
+	uint32_t q, r;
+	asm("divl %4"
+			: "=a"(q), "=d"(r)
+			: "a"((uint32_t)n), "d"((uint32_t)(n >> 32)), "rm"(d)
+			: "cc" );
+	return q;
+}
+
+/* 
+ * Divides a 64-bit number by a 32-bit one with two divls, the high half
+ * first, so the quotient may take all 64 bits.
+ */
+static inline uint64_t div64(uint64_t n, uint32_t d)
+{
+	uint32_t high = (uint32_t)(n >> 32);
+	uint32_t q_high = high / d;
+
+	return ((uint64_t)q_high << 32) | 
+	       div64_32(((uint64_t)(high % d) << 32) | (uint32_t)n, d);
+}
+
 #endif /* _LIB_H */
@@ -5,16 +5,48 @@
 #include "paging.h"
 #include "files.h"
 #include "syscalls.h"
+#include "frames.h"
+#include "process.h"
+#include "apic.h"
 
 
-/* 
- * The current process number, used in initializing a new 
- * page directory for the process. 
+
+/*
+ * map_direct_memory()
+ *
+ * Maps the physical memory from the end of the kernel page up to 
+ * DIRECT_MAP_LIMIT one-to-one, with global supervisor-only 4MB pages, so
+ * the kernel can use any frame below the limit at its physical address.
+ * The APIC registers at DEVICE_MAP_BASE are mapped one-to-one as well,
+ * uncached.
+ *
+ * Inputs: directory - the page directory to fill in
+ * Retvals: none
+ * 
  */
-int process_number;
+static void map_direct_memory( page_directory_t * directory )
+{
+	/* Local variables. */
+	uint32_t i;
+
+	for( i = DIRECT_MAP_FIRST_PDE; i < DIRECT_MAP_LIMIT / _4MB; i++ ) {
+		directory->dentries[i].MB.val = 0;
+		directory->dentries[i].MB.present = 1;
+		directory->dentries[i].MB.read_write = 1;
+		directory->dentries[i].MB.page_size = 1;
+		directory->dentries[i].MB.global = 1;
+		directory->dentries[i].MB.page_addr = i;
+	}
 
-/* Used to populate the PDBR with the new page directory address. */
-uint32_t new_page_dir_addr;
+	directory->dentries[DEVICE_MAP_PDE].MB.val = 0;
+	directory->dentries[DEVICE_MAP_PDE].MB.present = 1;
+	directory->dentries[DEVICE_MAP_PDE].MB.read_write = 1;
+	directory->dentries[DEVICE_MAP_PDE].MB.write_through = 1;
+	directory->dentries[DEVICE_MAP_PDE].MB.cache_disabled = 1;
+	directory->dentries[DEVICE_MAP_PDE].MB.page_size = 1;
+	directory->dentries[DEVICE_MAP_PDE].MB.global = 1;
+	directory->dentries[DEVICE_MAP_PDE].MB.page_addr = DEVICE_MAP_PDE;
+}
 
 
 
@@ -32,21 +64,28 @@ int32_t init_paging(void)
 	/* Local variables. */
 	int i;
 	int page_table_holder;
-	
-	process_number = 0;
 
 	/* Initialize page table for initial space pages. */
 	/* Set all to present except for the page at address 0. */
+	/* They are writable since the kernel honors write protection (CR0.WP). */
+	/* 
+	 * Every page directory, the kernel's and each process's, shares this
+	 * table, and processes reach the video buffers through it (see vidmap),
+	 * so it is user accessible everywhere. Being the same everywhere, it 
+	 * is global like the rest of the kernel's mappings: its translations
+	 * survive CR3 loads. Only the program image and mmap window, which 
+	 * differ between processes, are not global.
+	 */
 	for( i = 0; i < MAX_PAGE_TABLE_SIZE; i++ ) {
 		page_table[i].present = (i == 0) ? 0 : 1;
-		page_table[i].read_write = 0;
-		page_table[i].user_supervisor = 0;
+		page_table[i].read_write = 1;
+		page_table[i].user_supervisor = 1;
 		page_table[i].write_through = 0;
 		page_table[i].cache_disabled = 0;
 		page_table[i].accessed = 0;
 		page_table[i].dirty = 0;
 		page_table[i].pat = 0;
-		page_table[i].global = 0;
+		page_table[i].global = 1;
 		page_table[i].avail = 0;
 		page_table[i].page_addr = i;
 	}
@@ -54,8 +93,8 @@ int32_t init_paging(void)
 	/* Initialize first page directory entry. */
 	page_table_holder = (int)page_table;
 	page_directories[0].dentries[0].KB.present = 1;
-	page_directories[0].dentries[0].KB.read_write = 0;
-	page_directories[0].dentries[0].KB.user_supervisor = 0;
+	page_directories[0].dentries[0].KB.read_write = 1;
+	page_directories[0].dentries[0].KB.user_supervisor = 1;
 	page_directories[0].dentries[0].KB.write_through = 0;
 	page_directories[0].dentries[0].KB.cache_disabled = 0;
 	page_directories[0].dentries[0].KB.accessed = 0;
@@ -94,16 +133,23 @@ int32_t init_paging(void)
 	page_directories[0].dentries[i].MB.page_addr = i;
 	}
 
-	/* Set control registers to enable paging correctly. */
+	/* Map the memory the frame allocator hands to the kernel. */
+	map_direct_memory( &page_directories[0] );
+
+	/* 
+	 * Set control registers to enable paging correctly. Write protection
+	 * (CR0.WP) is turned on as well, so that the kernel writing into a shared
+	 * program page on a process's behalf also faults and gets it copied.
+	 */
 	asm (
 	"movl $page_directories, %%eax   ;"
 	"andl $0xFFFFFFE7, %%eax          ;"
 	"movl %%eax, %%cr3                ;"
 	"movl %%cr4, %%eax                ;"
-	"orl $0x00000010, %%eax           ;"
+	"orl $0x00000090, %%eax           ;"
 	"movl %%eax, %%cr4                ;"
 	"movl %%cr0, %%eax                ;"
-	"orl $0x80000000, %%eax 	      ;"
+	"orl $0x80010000, %%eax 	      ;"
 	"movl %%eax, %%cr0                 "
 	: : : "eax", "cc" );
 	
@@ -113,95 +159,511 @@ int32_t init_paging(void)
 /*
  * setup_new_task()
  *
- * Called from 'execute' to set up a new page directory.
+ * Called from 'execute' to set up a new page directory for a process, 
+ * together with the page tables for its program image and mmap window, and
+ * its data page (see vdso.h), and to load it. All four come from the frame
+ * allocator. Everything else is shared with the kernel's page directory, 
+ * global pages included.
  *
- * Inputs: process_number
+ * Inputs: pcb - the new process
  * Retvals: 0 on success, -1 on failure
  * 
  */
-int32_t setup_new_task( uint8_t process_number )
+int32_t setup_new_task( pcb_t * pcb )
 {
 	/* Local variables. */
-	uint32_t i;
-	int new_page_table_holder;
+	int page_table_holder;
+	page_directory_t * directory;
 	
-	/* Reject the request if it is out of range. */
-	if( process_number >= MAX_NUM_OF_PROCESSES ) {
+	/* Allocate the page directory and tables. */
+	pcb->page_directory = (page_directory_t *)frame_alloc(FRAME_KERNEL);
+	pcb->program_page_table = (pte_4KB_t *)frame_alloc(FRAME_KERNEL);
+	pcb->mmap_page_table = (pte_4KB_t *)frame_alloc(FRAME_KERNEL);
+	pcb->vdso = (vdso_data_t *)frame_alloc(FRAME_KERNEL);
+	if( pcb->page_directory == NULL || pcb->program_page_table == NULL || 
+	    pcb->mmap_page_table == NULL || pcb->vdso == NULL ) {
+		release_task( pcb );
 		return -1;
 	}
+	directory = pcb->page_directory;
+	memset(directory, 0, _4KB);
 	
-	/* Extract the new page directory address. */
-	new_page_dir_addr = (uint32_t)(&page_directories[process_number]);
-	
-	/* Initialize page table for initial space pages. */
-	/* Set all to present except for the page at address 0. */
-	for( i = 0; i < MAX_PAGE_TABLE_SIZE; i++ ) {
-		new_page_table[i].present = (i == 0) ? 0 : 1;
-		new_page_table[i].read_write = 1;
-		new_page_table[i].user_supervisor = 1;
-		new_page_table[i].write_through = 0;
-		new_page_table[i].cache_disabled = 0;
-		new_page_table[i].accessed = 0;
-		new_page_table[i].dirty = 0;
-		new_page_table[i].pat = 0;
-		new_page_table[i].global = 1;
-		new_page_table[i].avail = 0;
-		new_page_table[i].page_addr = i;
-	}
-
-	/* Initialize first page directory entry. */
-	new_page_table_holder = (int)new_page_table;
-	page_directories[process_number].dentries[0].KB.present = 1;
-	page_directories[process_number].dentries[0].KB.read_write = 1;
-	page_directories[process_number].dentries[0].KB.user_supervisor = 1;
-	page_directories[process_number].dentries[0].KB.write_through = 0;
-	page_directories[process_number].dentries[0].KB.cache_disabled = 0;
-	page_directories[process_number].dentries[0].KB.accessed = 0;
-	page_directories[process_number].dentries[0].KB.page_size = 0;
-	page_directories[process_number].dentries[0].KB.global = 0;
-	page_directories[process_number].dentries[0].KB.avail = 0;
-	page_directories[process_number].dentries[0].KB.table_addr = new_page_table_holder >> TABLE_ADDRESS_SHIFT;
+	/* Initialize first page directory entry, onto the kernel's page table for initial space pages. */
+	page_table_holder = (int)page_table;
+	directory->dentries[0].KB.present = 1;
+	directory->dentries[0].KB.read_write = 1;
+	directory->dentries[0].KB.user_supervisor = 1;
+	directory->dentries[0].KB.write_through = 0;
+	directory->dentries[0].KB.cache_disabled = 0;
+	directory->dentries[0].KB.accessed = 0;
+	directory->dentries[0].KB.page_size = 0;
+	directory->dentries[0].KB.global = 0;
+	directory->dentries[0].KB.avail = 0;
+	directory->dentries[0].KB.table_addr = page_table_holder >> TABLE_ADDRESS_SHIFT;
 	
 	/* Initialize the kernel page directory entry. */
-	page_directories[process_number].dentries[1].MB.present = 1;
-	page_directories[process_number].dentries[1].MB.read_write = 1;
-	page_directories[process_number].dentries[1].MB.user_supervisor = 0;
-	page_directories[process_number].dentries[1].MB.write_through = 0;
-	page_directories[process_number].dentries[1].MB.cache_disabled = 0;
-	page_directories[process_number].dentries[1].MB.accessed = 0;
-	page_directories[process_number].dentries[1].MB.dirty = 0;
-	page_directories[process_number].dentries[1].MB.page_size = 1;
-	page_directories[process_number].dentries[1].MB.global = 1;
-	page_directories[process_number].dentries[1].MB.avail = 0;
-	page_directories[process_number].dentries[1].MB.pat = 0;
-	page_directories[process_number].dentries[1].MB.page_addr = 1;
+	directory->dentries[1].MB.present = 1;
+	directory->dentries[1].MB.read_write = 1;
+	directory->dentries[1].MB.user_supervisor = 0;
+	directory->dentries[1].MB.write_through = 0;
+	directory->dentries[1].MB.cache_disabled = 0;
+	directory->dentries[1].MB.accessed = 0;
+	directory->dentries[1].MB.dirty = 0;
+	directory->dentries[1].MB.page_size = 1;
+	directory->dentries[1].MB.global = 1;
+	directory->dentries[1].MB.avail = 0;
+	directory->dentries[1].MB.pat = 0;
+	directory->dentries[1].MB.page_addr = 1;
 	
-	/* Set up a directory entry for the program image. */
-	page_directories[process_number].dentries[PROGRAM_IMG_ENTRY].MB.present = 1;
-	page_directories[process_number].dentries[PROGRAM_IMG_ENTRY].MB.read_write = 1;
-	page_directories[process_number].dentries[PROGRAM_IMG_ENTRY].MB.user_supervisor = 1;
-	page_directories[process_number].dentries[PROGRAM_IMG_ENTRY].MB.write_through = 0;
-	page_directories[process_number].dentries[PROGRAM_IMG_ENTRY].MB.cache_disabled = 0;
-	page_directories[process_number].dentries[PROGRAM_IMG_ENTRY].MB.accessed = 0;
-	page_directories[process_number].dentries[PROGRAM_IMG_ENTRY].MB.dirty = 0;
-	page_directories[process_number].dentries[PROGRAM_IMG_ENTRY].MB.page_size = 1;
-	page_directories[process_number].dentries[PROGRAM_IMG_ENTRY].MB.global = 0;
-	page_directories[process_number].dentries[PROGRAM_IMG_ENTRY].MB.avail = 0;
-	page_directories[process_number].dentries[PROGRAM_IMG_ENTRY].MB.pat = 0;
-	page_directories[process_number].dentries[PROGRAM_IMG_ENTRY].MB.page_addr = process_number+1;
+	/* Map the memory the frame allocator hands to the kernel. */
+	map_direct_memory( directory );
 	
-	/* Set control registers to enable paging correctly. */
-	asm (
-	"movl new_page_dir_addr, %%eax    ;"
-	"andl $0xFFFFFFE7, %%eax          ;"
-	"movl %%eax, %%cr3                ;"
-	"movl %%cr4, %%eax                ;"
-	"orl $0x00000090, %%eax           ;"
-	"movl %%eax, %%cr4                ;"
-	"movl %%cr0, %%eax                ;"
-	"orl $0x80000000, %%eax 	      ;"
-	"movl %%eax, %%cr0                 "
-	: : : "eax", "cc" );
+	/* 
+	 * Set up a directory entry for the program image. It is mapped in 4kB 
+	 * pages which are all left absent for now -- nothing is loaded, and no
+	 * memory is allocated for it, until the program touches it.
+	 */
+	memset(pcb->program_page_table, 0, _4KB);
+	directory->dentries[PROGRAM_IMG_ENTRY].KB.present = 1;
+	directory->dentries[PROGRAM_IMG_ENTRY].KB.read_write = 1;
+	directory->dentries[PROGRAM_IMG_ENTRY].KB.user_supervisor = 1;
+	directory->dentries[PROGRAM_IMG_ENTRY].KB.table_addr = 
+		(uint32_t)pcb->program_page_table >> TABLE_ADDRESS_SHIFT;
+
+	/* Start the process with an empty mmap window. */
+	memset(pcb->mmap_page_table, 0, _4KB);
+	directory->dentries[MMAP_ENTRY].KB.present = 1;
+	directory->dentries[MMAP_ENTRY].KB.read_write = 1;
+	directory->dentries[MMAP_ENTRY].KB.user_supervisor = 1;
+	directory->dentries[MMAP_ENTRY].KB.table_addr = 
+		(uint32_t)pcb->mmap_page_table >> TABLE_ADDRESS_SHIFT;
 	
+	/* The data page sits read-only at the end of the mmap window. */
+	pcb->mmap_page_table[VDSO_PAGE].present = 1;
+	pcb->mmap_page_table[VDSO_PAGE].read_write = 0;
+	pcb->mmap_page_table[VDSO_PAGE].user_supervisor = 1;
+	pcb->mmap_page_table[VDSO_PAGE].page_addr = (uint32_t)pcb->vdso >> TABLE_ADDRESS_SHIFT;
+	
+	load_page_directory( directory );
+	
+	return 0;
+}
+
+/*
+ * release_task()
+ *
+ * Gives the memory of a finished process back to the frame allocator: every
+ * private page of its program image, its data page, its page tables and its
+ * page directory.
+ * Shared pages belong to the file system image and are left alone. The 
+ * process's page directory must not be the one loaded.
+ *
+ * Inputs: pcb - the process
+ * Retvals: none
+ * 
+ */
+void release_task( pcb_t * pcb )
+{
+	/* Local variables. */
+	uint32_t i;
+	pte_4KB_t * table;
+
+	table = pcb->program_page_table;
+	if( table != NULL ) {
+		for( i = 0; i < MAX_PAGE_TABLE_SIZE; i++ ) {
+			if( table[i].present && table[i].avail != PTE_SHARED ) {
+				frame_free(table[i].page_addr << TABLE_ADDRESS_SHIFT);
+			}
+		}
+		frame_free((uint32_t)table);
+		pcb->program_page_table = NULL;
+	}
+
+	if( pcb->mmap_page_table != NULL ) {
+		frame_free((uint32_t)pcb->mmap_page_table);
+		pcb->mmap_page_table = NULL;
+	}
+
+	if( pcb->vdso != NULL ) {
+		frame_free((uint32_t)pcb->vdso);
+		pcb->vdso = NULL;
+	}
+
+	if( pcb->page_directory != NULL ) {
+		frame_free((uint32_t)pcb->page_directory);
+		pcb->page_directory = NULL;
+	}
+}
+
+/*
+ * load_page_directory()
+ *
+ * Loads a page directory into CR3, flushing every non-global translation.
+ *
+ * Inputs: directory - the page directory
+ * Retvals: none
+ * 
+ */
+void load_page_directory( page_directory_t * directory )
+{
+	asm volatile("movl %0, %%cr3"
+			:
+			: "r" ((uint32_t)directory & 0xFFFFFFE7)
+			: "memory");
+}
+
+/*
+ * switch_page_directory()
+ *
+ * Loads a page directory into CR3 unless it is already loaded, so that
+ * switching back to the same address space keeps its TLB entries.
+ *
+ * Inputs: directory - the page directory
+ * Retvals: none
+ * 
+ */
+void switch_page_directory( page_directory_t * directory )
+{
+	/* Local variables. */
+	uint32_t cr3;
+
+	asm volatile("movl %%cr3, %0" : "=r" (cr3));
+	if( (cr3 & 0xFFFFF000) != (uint32_t)directory )
+	{
+		load_page_directory( directory );
+	}
+}
+
+/*
+ * map_mmap_page()
+ *
+ * Maps the physical page at 'phys_addr' read-only, at user privilege, into
+ * slot 'page_index' of the process's mmap window. The last slot holds the
+ * process's data page (VDSO_PAGE) and cannot be mapped over.
+ *
+ * Inputs: pcb - the process whose window to map into
+ *         page_index - the page slot within the window
+ *         phys_addr - the (page aligned) physical address to map
+ * Retvals: 0 on success, -1 on failure
+ * 
+ */
+int32_t map_mmap_page( pcb_t * pcb, uint32_t page_index, uint32_t phys_addr )
+{
+	/* Local variables. */
+	pte_4KB_t * entry;
+
+	/* Reject the request if it is out of range. */
+	if( page_index >= VDSO_PAGE || pcb->mmap_page_table == NULL ) {
+		return -1;
+	}
+
+	entry = &pcb->mmap_page_table[page_index];
+	entry->val = 0;
+	entry->present = 1;
+	entry->read_write = 0;
+	entry->user_supervisor = 1;
+	entry->page_addr = phys_addr >> TABLE_ADDRESS_SHIFT;
+
+	/* Drop any stale translation for the slot. */
+	invlpg(MMAP_BASE + page_index*_4KB);
+
+	return 0;
+}
+
+/*
+ * unmap_mmap_page()
+ *
+ * Makes slot 'page_index' of the process's mmap window not present again,
+ * so it can be handed out to another mapping.
+ *
+ * Inputs: pcb - the process whose window to unmap from
+ *         page_index - the page slot within the window
+ * Retvals: none
+ * 
+ */
+void unmap_mmap_page( pcb_t * pcb, uint32_t page_index )
+{
+	if( page_index >= VDSO_PAGE || pcb->mmap_page_table == NULL ) {
+		return;
+	}
+
+	pcb->mmap_page_table[page_index].val = 0;
+	invlpg(MMAP_BASE + page_index*_4KB);
+}
+
+/*
+ * fill_program_page()
+ *
+ * Makes page 'page_index' of a process's program image present. The program
+ * is loaded at a page aligned address, so each file page comes from exactly
+ * one data block. The resident file system image serves as the cache of 
+ * every executable: a page wholly covered by the file is mapped read-only 
+ * straight onto its data block, shared by every process running the same
+ * program, and only copied if the process writes to it. The last, partial
+ * page of the file is copied into a newly allocated frame with the rest 
+ * zeroed, and so is every page past the end of the file (the bss, the heap
+ * and the stack). Pages are filled through their user virtual address, so
+ * the process's page directory must be the one loaded.
+ *
+ * Inputs: pcb - the process that faulted
+ *         page_index - the page within the 4MB program image
+ * Retvals: 0 on success, -1 on failure
+ * 
+ */
+int32_t fill_program_page( pcb_t * pcb, uint32_t page_index )
+{
+	/* Local variables. */
+	pte_4KB_t * entry;
+	inode_t * image;
+	uint8_t * page;
+	uint8_t * block;
+	uint32_t offset;
+	uint32_t length;
+	uint32_t frame;
+
+	/* Reject the request if it is out of range or already present. */
+	if( page_index >= MAX_PAGE_TABLE_SIZE || pcb->program_page_table == NULL ) {
+		return -1;
+	}
+	entry = &pcb->program_page_table[page_index];
+	if( entry->present ) {
+		return -1;
+	}
+
+	/* Find the program file, which execute recorded in the PCB. */
+	image = pcb->program_image;
+	page = (uint8_t *)(_128MB + page_index*_4KB);
+
+	/* Work out how much of this page comes from the file. */
+	length = 0;
+	block = NULL;
+	if( image != NULL && (uint32_t)page >= PROGRAM_LOAD_ADDR ) {
+		offset = (uint32_t)page - PROGRAM_LOAD_ADDR;
+		if( offset < image->size ) {
+			length = image->size - offset;
+			if( length > _4KB ) {
+				length = _4KB;
+			}
+			block = fs_block_address(image, offset / FS_PAGE_SIZE);
+			if( block == NULL ) {
+				return -1;
+			}
+		}
+	}
+
+	/* Absent entries are never cached by the TLB, so no flush is needed. */
+	entry->present = 1;
+	entry->user_supervisor = 1;
+
+	/* Share whole pages of the file in place, if the image is page aligned. */
+	if( length == _4KB && fs_blocks_mappable() ) {
+		entry->read_write = 0;
+		entry->avail = PTE_SHARED;
+		entry->page_addr = (uint32_t)block >> TABLE_ADDRESS_SHIFT;
+		return 0;
+	}
+
+	/* Everything else gets a frame of its own. */
+	frame = frame_alloc(FRAME_USER);
+	if( frame == 0 ) {
+		entry->val = 0;
+		return -1;
+	}
+	entry->page_addr = frame >> TABLE_ADDRESS_SHIFT;
+	entry->read_write = 1;
+	if( block != NULL ) {
+		memcpy(page, block, length);
+	}
+	memset(page + length, 0, _4KB - length);
+
+	return 0;
+}
+
+/*
+ * copy_program_page()
+ *
+ * Breaks the sharing of a program page after a write to it: the page is 
+ * moved onto a newly allocated frame, which is made writable, and the 
+ * shared data block is copied into it. The data block stays reachable 
+ * through the kernel's own mapping, so no bounce buffer is needed.
+ *
+ * Inputs: pcb - the process that faulted
+ *         page_index - the page within the 4MB program image
+ * Retvals: 0 on success, -1 on failure (the page was not shared)
+ * 
+ */
+int32_t copy_program_page( pcb_t * pcb, uint32_t page_index )
+{
+	/* Local variables. */
+	pte_4KB_t * entry;
+	uint8_t * page;
+	uint8_t * block;
+	uint32_t frame;
+
+	/* Reject the request if it is out of range or not a shared page. */
+	if( page_index >= MAX_PAGE_TABLE_SIZE || pcb->program_page_table == NULL ) {
+		return -1;
+	}
+	entry = &pcb->program_page_table[page_index];
+	if( !entry->present || entry->avail != PTE_SHARED ) {
+		return -1;
+	}
+
+	frame = frame_alloc(FRAME_USER);
+	if( frame == 0 ) {
+		return -1;
+	}
+
+	block = (uint8_t *)(entry->page_addr << TABLE_ADDRESS_SHIFT);
+	page = (uint8_t *)(_128MB + page_index*_4KB);
+
+	entry->page_addr = frame >> TABLE_ADDRESS_SHIFT;
+	entry->read_write = 1;
+	entry->avail = 0;
+	invlpg(page);
+
+	memcpy(page, block, _4KB);
+
 	return 0;
 }
+
+/*
+ * page_fault_interruption()
+ *
+ * The handler for a page fault. Faults on absent pages of the program image
+ * are how programs get loaded, so those are filled in and the faulting 
+ * instruction is retried, as are writes to shared pages, which get copied.
+ * Anything else is a real fault, which prints a message and spins like the
+ * other exceptions.
+ *
+ * Inputs: fault_addr - the faulting linear address (CR2)
+ *         error_code - the error code pushed by the processor
+ * Retvals: none
+ * 
+ */
+void page_fault_interruption( uint32_t fault_addr, uint32_t error_code )
+{
+	/* Local variables. */
+	uint32_t directory;
+	pcb_t * faulting_process;
+	uint32_t page_index;
+
+	if( fault_addr >= _128MB && fault_addr < _128MB + _4MB ) {
+
+		/* 
+		 * The faulting process is the current one, whose page directory is 
+		 * the one loaded. Check that, since a fault taken while switching 
+		 * processes would otherwise fill in the wrong process's page.
+		 */
+		faulting_process = get_current_pcb();
+		asm volatile("movl %%cr3, %0" : "=r"(directory));
+		page_index = (fault_addr - _128MB) / _4KB;
+
+		if( faulting_process != NULL && 
+		    (uint32_t)faulting_process->page_directory == (directory & ~(_4KB - 1)) ) {
+			if( !(error_code & PF_ERROR_PRESENT) ) {
+				if( 0 == fill_program_page( faulting_process, page_index ) ) {
+					return;
+				}
+			}
+			else if( error_code & PF_ERROR_WRITE ) {
+				if( 0 == copy_program_page( faulting_process, page_index ) ) {
+					return;
+				}
+			}
+		}
+	}
+
+	printf("Page Fault Exception!\n");
+	while(1);
+}
+
+#ifdef BENCHMARK
+/*
+ * flush_all_tlb()
+ *
+ * Flushes every TLB entry, global ones included, by turning CR4.PGE off
+ * and on again.
+ *
+ * Inputs: none
+ * Retvals: none
+ * 
+ */
+static void flush_all_tlb( void )
+{
+	asm volatile("movl %%cr4, %%eax        ;"
+	             "andl $~0x80, %%eax       ;"
+	             "movl %%eax, %%cr4        ;"
+	             "orl $0x80, %%eax         ;"
+	             "movl %%eax, %%cr4         "
+	             : : : "eax", "memory");
+}
+
+/*
+ * paging_bench_round()
+ *
+ * Loads CR3, as a context switch does, then touches PAGING_BENCH_PAGES
+ * pages of the initial space page table, as the kernel does after one, 
+ * PAGING_BENCH_ITERATIONS times.
+ *
+ * Inputs: none
+ * Retvals: the average cycles per round
+ * 
+ */
+static uint32_t paging_bench_round( void )
+{
+	/* Local variables. */
+	volatile uint32_t * page;
+	uint64_t start;
+	uint32_t i, j;
+
+	start = rdtsc();
+	for( i = 0; i < PAGING_BENCH_ITERATIONS; i++ ) {
+		load_page_directory( &page_directories[0] );
+		for( j = 0; j < PAGING_BENCH_PAGES; j++ ) {
+			page = (volatile uint32_t *)(PAGING_BENCH_BASE + j*_4KB);
+			(void)*page;
+		}
+	}
+
+	return (uint32_t)(rdtsc() - start) / PAGING_BENCH_ITERATIONS;
+}
+
+/*
+ * paging_bench()
+ *
+ * Microbenchmark for global pages. Times a CR3 load followed by touching
+ * PAGING_BENCH_PAGES kernel pages, with those pages global (as they are
+ * now) and again with them made non-global (as they used to be), so that
+ * each CR3 load flushes them and every touch after it misses the TLB. 
+ * Prints the average cost of a round of each kind in cycles, and puts
+ * the pages back the way they were.
+ *
+ * Inputs: none
+ * Retvals: none
+ * 
+ */
+void paging_bench( void )
+{
+	/* Local variables. */
+	uint32_t global, non_global;
+	uint32_t first = PAGING_BENCH_BASE / _4KB;
+	uint32_t i;
+
+	global = paging_bench_round();
+
+	for( i = first; i < first + PAGING_BENCH_PAGES; i++ ) {
+		page_table[i].global = 0;
+	}
+	flush_all_tlb();
+	non_global = paging_bench_round();
+
+	for( i = first; i < first + PAGING_BENCH_PAGES; i++ ) {
+		page_table[i].global = 1;
+	}
+	flush_all_tlb();
+
+	printf("CR3 load + %u page touches (cycles): global %u, non-global %u\n",
+	       PAGING_BENCH_PAGES, global, non_global);
+}
+#endif /* BENCHMARK */
@@ -12,8 +12,37 @@
 
 
 #define	TABLE_ADDRESS_SHIFT		12
-#define MAX_NUM_OF_PROCESSES	8
 #define PROGRAM_IMG_ENTRY		0x20
+#define MMAP_ENTRY				0x21
+#define MMAP_BASE				(_128MB + _4MB)
+
+/* Page fault error code bits. */
+#define PF_ERROR_PRESENT		0x1
+#define PF_ERROR_WRITE			0x2
+
+/* 
+ * Marks (in a PTE's avail bits) a read-only program page that is shared 
+ * straight out of the file system image and gets copied on write.
+ */
+#define PTE_SHARED				0x1
+
+/* The pages paging_bench touches after each CR3 load (in the initial space, past 1MB). */
+#define PAGING_BENCH_BASE		0x100000
+#define PAGING_BENCH_PAGES		64
+#define PAGING_BENCH_ITERATIONS	10000
+
+/* Invalidates the TLB entry for the page containing 'addr'. */
+#define invlpg(addr)                    \
+do {                                    \
+	asm volatile("invlpg (%0)"          \
+			:                           \
+			: "r" (addr)                \
+			: "memory");                \
+} while(0)
+
+
+
+struct pcb_t;
 
 
 
@@ -21,7 +50,34 @@
 int32_t init_paging(void);
 
 /* Called from 'execute' to set up a new page directory. */
-int32_t setup_new_task( uint8_t process_number );
+int32_t setup_new_task( struct pcb_t * pcb );
+
+/* Frees the page directory and memory of a process that has finished. */
+void release_task( struct pcb_t * pcb );
+
+/* Loads a page directory into CR3. */
+void load_page_directory( page_directory_t * directory );
+
+/* Loads a page directory into CR3, unless it is already loaded. */
+void switch_page_directory( page_directory_t * directory );
+
+/* Compares the cost of a CR3 load with kernel pages global and non-global. */
+void paging_bench( void );
+
+/* Maps a physical page read-only into a process's mmap window. */
+int32_t map_mmap_page( struct pcb_t * pcb, uint32_t page_index, uint32_t phys_addr );
+
+/* Removes a page from a process's mmap window. */
+void unmap_mmap_page( struct pcb_t * pcb, uint32_t page_index );
+
+/* Fills in one page of a process's program image on first touch. */
+int32_t fill_program_page( struct pcb_t * pcb, uint32_t page_index );
+
+/* Gives a process its own copy of a shared program page it wrote to. */
+int32_t copy_program_page( struct pcb_t * pcb, uint32_t page_index );
+
+/* The handler for a page fault, called from the asm wrapper. */
+void page_fault_interruption( uint32_t fault_addr, uint32_t error_code );
 
 #endif /* PAGING_H */
 
@@ -0,0 +1,343 @@
+/************************************************/
+/* process.c - The process table of the kernel. */
+/************************************************/
+#include "process.h"
+#include "frames.h"
+#include "slab.h"
+#include "scheduler.h"
+#include "lib.h"
+#include "smp.h"
+
+
+/*
+ * The PID table. It is a two level table like a page table: each page holds
+ * the PCB pointers for 1024 consecutive PIDs and is only allocated once one
+ * of those PIDs is handed out, so looking a PID up is two array accesses no
+ * matter how many processes there are.
+ */
+pcb_t ** pid_table[PID_TABLE_PAGES];
+
+/* Where the search for the next free PID starts. */
+uint32_t next_pid = 1;
+
+/* The number of processes in the table. */
+uint32_t num_processes;
+
+/*
+ * All live processes, in a circular list through their PCBs (NULL when
+ * there are none). The scheduler walks it from the current process.
+ */
+pcb_t * process_list;
+
+/* The cache the PCBs are allocated from. */
+slab_cache_t pcb_cache;
+
+/*
+ * The kernel stack of a process that was destroyed while the stack was 
+ * still in use (a process halting itself). It is freed by the next create 
+ * or destroy, which by then runs on some other stack.
+ */
+uint32_t exited_stack;
+
+
+
+/*
+ * process_init()
+ *
+ * Description:
+ * Sets up the PCB cache. Must run after slab_init.
+ *
+ * Inputs: none
+ * Retvals: none
+ */
+void process_init(void)
+{
+	slab_cache_init(&pcb_cache, "pcb", sizeof(pcb_t));
+}
+
+/*
+ * reap_exited()
+ *
+ * Description:
+ * Frees the kernel stack of a process destroyed while it was still on it,
+ * unless that is still the stack in use.
+ *
+ * Inputs: none
+ * Retvals: none
+ */
+static void reap_exited(void)
+{
+	/* Local variables. */
+	uint32_t esp;
+
+	if( exited_stack == 0 )
+	{
+		return;
+	}
+
+	asm volatile("movl %%esp, %0":"=g"(esp));
+	if( (esp & ALIGN_8KB) == exited_stack )
+	{
+		return;
+	}
+
+	frame_free_block(exited_stack, KERNEL_STACK_FRAMES);
+	exited_stack = 0;
+}
+
+/*
+ * alloc_pid()
+ *
+ * Description:
+ * Finds a free PID, starting after the last one handed out so that PIDs
+ * are not reused straight away, and makes sure its table page exists.
+ *
+ * Inputs: none
+ * Retvals:
+ * PID_NONE: failure (no PIDs or memory left)
+ * the PID otherwise
+ */
+static uint32_t alloc_pid(void)
+{
+	/* Local variables. */
+	uint32_t i;
+	uint32_t pid;
+	uint32_t page;
+
+	for( i = 0; i < MAX_PIDS; i++ )
+	{
+		pid = next_pid;
+		next_pid = (next_pid + 1) % MAX_PIDS;
+		if( pid == PID_NONE )
+		{
+			continue;
+		}
+
+		page = pid / PID_TABLE_PAGE_ENTRIES;
+		if( pid_table[page] == NULL )
+		{
+			pid_table[page] = (pcb_t **)frame_alloc(FRAME_KERNEL);
+			if( pid_table[page] == NULL )
+			{
+				return PID_NONE;
+			}
+			memset(pid_table[page], 0, _4KB);
+		}
+
+		if( pid_table[page][pid % PID_TABLE_PAGE_ENTRIES] == NULL )
+		{
+			return pid;
+		}
+	}
+
+	return PID_NONE;
+}
+
+/*
+ * process_create()
+ *
+ * Description:
+ * Allocates a PCB from the PCB cache and an 8kB kernel stack for a new 
+ * process, gives it a PID, and adds it to the process table and the list 
+ * of live processes. The rest of the PCB is left for the caller to fill in.
+ *
+ * Inputs: none
+ * Retvals:
+ * NULL: failure (no memory or PIDs left)
+ * the new PCB otherwise
+ */
+pcb_t * process_create(void)
+{
+	/* Local variables. */
+	pcb_t * pcb;
+	uint32_t stack;
+	uint32_t pid;
+	uint32_t flags;
+
+	cli_and_save(flags);
+	reap_exited();
+
+	pcb = (pcb_t *)slab_alloc(&pcb_cache);
+	if( pcb == NULL )
+	{
+		restore_flags(flags);
+		return NULL;
+	}
+
+	stack = frame_alloc_block(KERNEL_STACK_FRAMES, FRAME_KERNEL);
+	if( stack == 0 )
+	{
+		slab_free(pcb);
+		restore_flags(flags);
+		return NULL;
+	}
+
+	pid = alloc_pid();
+	if( pid == PID_NONE )
+	{
+		frame_free_block(stack, KERNEL_STACK_FRAMES);
+		slab_free(pcb);
+		restore_flags(flags);
+		return NULL;
+	}
+
+	memset(pcb, 0, sizeof(pcb_t));
+	pcb->process_number = pid;
+	pcb->kernel_stack = stack;
+	pcb->priority = PRIORITY_DEFAULT;
+	pcb->cpu = this_cpu()->index;
+	pid_table[pid / PID_TABLE_PAGE_ENTRIES][pid % PID_TABLE_PAGE_ENTRIES] = pcb;
+
+	/* Add it to the end of the circular list, just behind the head. */
+	if( process_list == NULL )
+	{
+		pcb->next = pcb;
+		pcb->prev = pcb;
+		process_list = pcb;
+	}
+	else
+	{
+		pcb->next = process_list;
+		pcb->prev = process_list->prev;
+		process_list->prev->next = pcb;
+		process_list->prev = pcb;
+	}
+	num_processes++;
+
+	restore_flags(flags);
+	return pcb;
+}
+
+/*
+ * process_destroy()
+ *
+ * Description:
+ * Removes a process from the process table and the list of live processes
+ * and frees its PCB and kernel stack. If that is the stack we are running
+ * on (a process halting itself), freeing the stack waits until we have
+ * left it. The PCB itself is freed straight away.
+ *
+ * Inputs: pcb - the process to destroy
+ * Retvals: none
+ */
+void process_destroy(pcb_t * pcb)
+{
+	/* Local variables. */
+	uint32_t pid;
+	uint32_t flags;
+	uint32_t esp;
+
+	if( pcb == NULL )
+	{
+		return;
+	}
+
+	cli_and_save(flags);
+	reap_exited();
+
+	pid = pcb->process_number;
+	if( process_lookup(pid) == pcb )
+	{
+		pid_table[pid / PID_TABLE_PAGE_ENTRIES][pid % PID_TABLE_PAGE_ENTRIES] = NULL;
+	}
+
+	if( pcb->next == pcb )
+	{
+		process_list = NULL;
+	}
+	else
+	{
+		pcb->prev->next = pcb->next;
+		pcb->next->prev = pcb->prev;
+		if( process_list == pcb )
+		{
+			process_list = pcb->next;
+		}
+	}
+	num_processes--;
+
+	if( this_cpu()->current == pcb )
+	{
+		this_cpu()->current = NULL;
+	}
+
+	/* Free the stack now, unless we are still running on it. */
+	asm volatile("movl %%esp, %0":"=g"(esp));
+	if( (esp & ALIGN_8KB) == pcb->kernel_stack )
+	{
+		exited_stack = pcb->kernel_stack;
+	}
+	else
+	{
+		frame_free_block(pcb->kernel_stack, KERNEL_STACK_FRAMES);
+	}
+	slab_free(pcb);
+
+	restore_flags(flags);
+}
+
+/*
+ * process_lookup()
+ *
+ * Description:
+ * Returns the PCB of the process with the given PID.
+ *
+ * Inputs: pid - the PID
+ * Retvals:
+ * NULL: no such process
+ * the PCB otherwise
+ */
+pcb_t * process_lookup(uint32_t pid)
+{
+	if( pid == PID_NONE || pid >= MAX_PIDS || pid_table[pid / PID_TABLE_PAGE_ENTRIES] == NULL )
+	{
+		return NULL;
+	}
+
+	return pid_table[pid / PID_TABLE_PAGE_ENTRIES][pid % PID_TABLE_PAGE_ENTRIES];
+}
+
+/*
+ * process_count()
+ *
+ * Description:
+ * Returns the number of processes in the table.
+ *
+ * Inputs: none
+ * Retvals: the number of processes
+ */
+uint32_t process_count(void)
+{
+	return num_processes;
+}
+
+/*
+ * set_current_pcb
+ *
+ * Sets the process running on this processor (each has its own). The 
+ * page directory of the process must be the one loaded, since the page 
+ * fault handler relies on it.
+ *
+ * Inputs: setter value.
+ *
+ * Retvals: none
+ */
+void set_current_pcb(pcb_t * pcb)
+{
+	this_cpu()->current = pcb;
+}
+
+/*
+ * get_current_pcb
+ *
+ * Gets the process running on this processor (NULL while it idles, or
+ * before the first one starts).
+ *
+ * Inputs: none.
+ *
+ * Retvals: getter value.
+ */
+pcb_t * get_current_pcb(void)
+{
+	return this_cpu()->current;
+}
@@ -0,0 +1,55 @@
+/************************************************/
+/* process.h - The process table of the kernel. */
+/************************************************/
+#ifndef PROCESS_H
+#define PROCESS_H
+
+
+
+#include "types.h"
+#include "syscalls.h"
+
+
+
+/* Constants. */
+#define PID_NONE                0        // the "no processes running" process
+#define MAX_PIDS                32768
+#define PID_TABLE_PAGE_ENTRIES  (_4KB / sizeof(pcb_t *))
+#define PID_TABLE_PAGES         (MAX_PIDS / PID_TABLE_PAGE_ENTRIES)
+
+/* Process states. */
+#define TASK_RUNNABLE           0
+#define TASK_BLOCKED            1        // asleep on a wait queue
+
+/* Each process has an 8kB kernel stack, aligned to its size. */
+#define KERNEL_STACK_SIZE       _8KB
+#define KERNEL_STACK_FRAMES     (KERNEL_STACK_SIZE / _4KB)
+
+/* The initial kernel stack pointer of a process (the top of its stack). */
+#define KERNEL_STACK_BOTTOM(pcb)  ((pcb)->kernel_stack + KERNEL_STACK_SIZE - 4)
+
+
+
+/* Sets up the PCB cache. */
+void process_init(void);
+
+/* Allocates a PCB and kernel stack and gives the process a PID. */
+pcb_t * process_create(void);
+
+/* Removes a process from the table and frees its PCB and kernel stack. */
+void process_destroy(pcb_t * pcb);
+
+/* Returns the PCB of the process with the given PID, or NULL. */
+pcb_t * process_lookup(uint32_t pid);
+
+/* Returns the number of processes in the table. */
+uint32_t process_count(void);
+
+/* Setter function */
+void set_current_pcb(pcb_t * pcb);
+/* Getter function */
+pcb_t * get_current_pcb(void);
+
+
+
+#endif /* PROCESS_H */
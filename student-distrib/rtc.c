@@ -5,12 +5,18 @@
 #include "rtc.h"
 #include "i8259.h"
 #include "keyboard.h"
+#include "scheduler.h"
+#include "files.h"
+#include "slab.h"
 
 
 
-/* Flag used to lock an rtc_read and prevent its returning until a
- * clock interrupt occurs.  */
-volatile int interrupt_occurred = 0;
+/* The virtual clocks of every open rtc file. */
+rtc_clock_t * rtc_clocks;
+
+/* The rate the RTC runs at, and the time to the next screen update. */
+uint32_t rtc_base_freq;
+int32_t screen_countdown;
 
 
 
@@ -50,22 +56,61 @@ void rtc_init(void)
 	 * NOTE -- We need this to be fast enough since we are using the RTC
 	 *         to repaint the screen
 	 */
-	int hertz = 32;
-	rtc_write(&hertz, 4);
+	rtc_base_freq = RTC_SCREEN_FREQ;
+	screen_countdown = RTC_MAX_FREQ / RTC_SCREEN_FREQ;
+	rtc_set_frequency(rtc_base_freq);
 	
 	enable_irq(RTC_IRQ);
 }
 
+/*
+ * rtc_update_base()
+ *
+ * Runs the RTC at the fastest rate any open rtc file, or the screen, 
+ * needs, so that no interrupt is wasted on a rate nobody asked for. The
+ * virtual clocks count in 1/RTC_MAX_FREQ seconds, so they carry on 
+ * across the change. Called with interrupts masked.
+ *
+ * Inputs: none
+ * Retvals: none
+ */
+static void rtc_update_base(void)
+{
+	/* Local variables. */
+	rtc_clock_t * clock;
+	uint32_t freq = RTC_SCREEN_FREQ;
+
+	for( clock = rtc_clocks; clock != NULL; clock = clock->next )
+	{
+		if( clock->freq > freq )
+		{
+			freq = clock->freq;
+		}
+	}
+
+	if( freq != rtc_base_freq )
+	{
+		rtc_base_freq = freq;
+		rtc_set_frequency(freq);
+	}
+}
+
 /*
  * clock_interruption()
  *
- * The handler for an RTC interrupt.
+ * The handler for an RTC interrupt. Advances every virtual clock by one
+ * period of the RTC, and wakes only the readers of the clocks that
+ * ticked. The screen is updated at RTC_SCREEN_FREQ the same way.
  *
  * Inputs: none
  * Retvals: none
  */
 void clock_interruption(void) 
 {
+	/* Local variables. */
+	rtc_clock_t * clock;
+	int32_t step;
+
 	/* Mask interrupts */
 	cli();
 
@@ -78,11 +123,34 @@ void clock_interruption(void)
 	/* Send End-of-Interrupt */
 	send_eoi(RTC_IRQ);
 
-	/* Set the interrupt_occured flag to one. */
-	interrupt_occurred = 1;
+	/* Count the clocks down, and wake up the readers of those that ticked. */
+	step = RTC_MAX_FREQ / rtc_base_freq;
+	for( clock = rtc_clocks; clock != NULL; clock = clock->next )
+	{
+		if( clock->freq == 0 )
+		{
+			continue;
+		}
+		
+		clock->countdown -= step;
+		if( clock->countdown <= 0 )
+		{
+			clock->countdown += RTC_MAX_FREQ / clock->freq;
+			clock->ticks++;
+			wake_up(&clock->wait);
+		}
+	}
 	
 	/* Update the video memory to match the appropriate video buffer */
-	update_vid();
+	screen_countdown -= step;
+	if( screen_countdown <= 0 )
+	{
+		screen_countdown += RTC_MAX_FREQ / RTC_SCREEN_FREQ;
+		update_vid();
+	}
+	
+	/* Run a woken reader on the focused terminal right away. */
+	sched_preempt();
 	
 	/* Unmask interrupts */
 	sti();
@@ -91,23 +159,31 @@ void clock_interruption(void)
 /*
  * rtc_read()
  *
- * Should always return 0, but only after an interrupt has occurred 
- * (set a flag and wait until the interrupt handler clears it, then 
- * return 0).
+ * Should always return 0, but only after the file's virtual clock has
+ * ticked since it was last read (wait until the interrupt handler counts
+ * a tick, then return 0).
  *
- * Inputs: none
- * Retvals: none
+ * Inputs: 
+ * fd: the open rtc file
+ * buf, nbytes: ignored
+ * Retvals: 0
  */
-int32_t rtc_read (uint32_t a, int32_t b, int32_t c, int32_t d) 
+int32_t rtc_read (struct file_descriptor_t * fd, void * buf, int32_t nbytes) 
 {
-	/* Spin until the interrupt has occurred */
-	while (!interrupt_occurred) 
+	/* Local variables. */
+	rtc_clock_t * clock = (rtc_clock_t *)fd->driver_data;
+	uint32_t flags;
+	
+	/* Sleep until the clock has ticked */
+	cli_and_save(flags);
+	while (clock->ticks == 0) 
 	{
-		/* Do nothing. */
+		sleep_on(&clock->wait);
 	}
 	
-	/* Clear the flag. */
-	interrupt_occurred = 0;
+	/* Clear the ticks. */
+	clock->ticks = 0;
+	restore_flags(flags);
 
 	/* Always return 0. */
 	return 0;
@@ -117,20 +193,24 @@ int32_t rtc_read (uint32_t a, int32_t b, int32_t c, int32_t d)
  * rtc_write()
  *
  * Should always accept only a 4-byte integer specifying the interrupt 
- * rate in Hz, and should set the rate of periodic interrupts accordingly.
+ * rate in Hz, and should set the rate of the file's virtual clock 
+ * accordingly: a power of two up to RTC_MAX_FREQ, or 0 to stop it. The
+ * other open rtc files keep their own rates.
  *
  * Inputs: 
+ * fd: the open rtc file
  * buf: hz to be set
  * nbytes: number of bytes to set
  * Retvals
  * -1: failure
- * n: number of bytes written
+ * 0: success
  */
-int32_t rtc_write (int32_t * buf, int32_t nbytes) 
+int32_t rtc_write (struct file_descriptor_t * fd, const void * buf, int32_t nbytes) 
 {
 	/* Local variables. */
+	rtc_clock_t * clock = (rtc_clock_t *)fd->driver_data;
 	int32_t freq;
-	int8_t rs;
+	uint32_t flags;
 	
 	/* If rtc_write doesn't receive 4 bytes, fail. */	
 	if (4 != nbytes) 
@@ -143,10 +223,38 @@ int32_t rtc_write (int32_t * buf, int32_t nbytes)
 	{
 		return -1;
 	} 
-	else 
+
+	/* Only powers of two the RTC itself could run at will do. */
+	freq = *(const int32_t *)buf;
+	if( freq < 0 || freq > RTC_MAX_FREQ || (freq & (freq - 1)) != 0 || freq == 1 )
 	{
-		freq = *buf;
+		return -1;
 	}
+	
+	cli_and_save(flags);
+	clock->freq = freq;
+	clock->countdown = freq != 0 ? RTC_MAX_FREQ / freq : 0;
+	rtc_update_base();
+	restore_flags(flags);
+	
+	return 0;
+}
+
+/*
+ * rtc_set_frequency()
+ *
+ * Sets the rate of the RTC's periodic interrupts.
+ *
+ * Inputs: 
+ * freq: hz to be set, a power of two up to 1024 (or 0 to stop)
+ * Retvals
+ * -1: failure
+ * 0: success
+ */
+int32_t rtc_set_frequency (int32_t freq)
+{
+	/* Local variables. */
+	int8_t rs;
 
 	/* Get the old value of RTC Register A to save values we don't change. */
 	outb(INDEX_REGISTER_A, RTC_PORT);
@@ -184,26 +292,78 @@ int32_t rtc_write (int32_t * buf, int32_t nbytes)
 /*
  * rtc_open()
  *
- * Opens the RTC.
+ * Opens the RTC, giving the file a virtual clock of its own, ticking at
+ * RTC_DEFAULT_FREQ until it is written.
  *
- * Inputs: none
- * Retvals: 0
+ * Inputs: fd - the open rtc file
+ * Retvals: 
+ * -1: out of memory
+ * 0: success
  */
-int32_t rtc_open (void) 
+int32_t rtc_open (struct file_descriptor_t * fd) 
 {
+	/* Local variables. */
+	rtc_clock_t * clock;
+	uint32_t flags;
+	
+	clock = (rtc_clock_t *)kmalloc(sizeof(rtc_clock_t));
+	if( clock == NULL )
+	{
+		return -1;
+	}
+	
+	memset(clock, 0, sizeof(rtc_clock_t));
+	clock->freq = RTC_DEFAULT_FREQ;
+	clock->countdown = RTC_MAX_FREQ / RTC_DEFAULT_FREQ;
+	fd->driver_data = clock;
+	
+	cli_and_save(flags);
+	clock->next = rtc_clocks;
+	if( rtc_clocks != NULL )
+	{
+		rtc_clocks->prev = clock;
+	}
+	rtc_clocks = clock;
+	rtc_update_base();
+	restore_flags(flags);
+	
 	return 0;
 }
 
 /*
  * rtc_close()
  *
- * Closes the RTC.
+ * Closes the RTC, freeing the file's virtual clock. The RTC slows down
+ * if the clock was the fastest.
  *
- * Inputs: none
+ * Inputs: fd - the open rtc file
  * Retvals: 0 
  */
-int32_t rtc_close (void) 
+int32_t rtc_close (struct file_descriptor_t * fd) 
 {
+	/* Local variables. */
+	rtc_clock_t * clock = (rtc_clock_t *)fd->driver_data;
+	uint32_t flags;
+	
+	cli_and_save(flags);
+	if( clock->prev != NULL )
+	{
+		clock->prev->next = clock->next;
+	}
+	else
+	{
+		rtc_clocks = clock->next;
+	}
+	if( clock->next != NULL )
+	{
+		clock->next->prev = clock->prev;
+	}
+	rtc_update_base();
+	restore_flags(flags);
+	
+	kfree(clock);
+	fd->driver_data = NULL;
+	
 	return 0;
 }
 
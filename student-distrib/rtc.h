@@ -6,6 +6,10 @@
 
 
 
+#include "types.h"
+#include "scheduler.h"
+
+
 /* IO Constants. */
 #define RTC_PORT		0x70
 #define CMOS_PORT		0x71
@@ -34,9 +38,37 @@
 #define HZ512			0x07
 #define HZ1024			0x06
 
+/* 
+ * Every open rtc file has a virtual clock of its own, driven by the RTC
+ * running at the fastest rate any of them (or the screen) needs. They all
+ * count down in 1/RTC_MAX_FREQ seconds, whatever the RTC runs at.
+ */
+#define RTC_MAX_FREQ		1024
+#define RTC_DEFAULT_FREQ	32
+#define RTC_SCREEN_FREQ		32
+
 /* IRQ Constant. */
 #define RTC_IRQ			8
 
+struct file_descriptor_t;
+
+/* Explanation:
+ * The virtual clock of an open rtc file.
+ *    freq -- Its rate in Hz, or 0 while it is stopped.
+ *    countdown -- The time to its next tick, in 1/RTC_MAX_FREQ seconds.
+ *    ticks -- The ticks since it was last read.
+ *    wait -- The processes blocked reading it.
+ *    next, prev -- Links in the list of open rtc files.
+ */
+typedef struct rtc_clock_t {
+	uint32_t freq;
+	int32_t countdown;
+	uint32_t ticks;
+	wait_queue_t wait;
+	struct rtc_clock_t * next;
+	struct rtc_clock_t * prev;
+} rtc_clock_t;
+
 /* Initializes the RTC for usage. */
 void rtc_init(void);
 
@@ -44,16 +76,19 @@ void rtc_init(void);
 void clock_interruption(void); 
 
 /* Should always return 0, but only after an interrupt has occurred. */
-int32_t rtc_read (uint32_t a, int32_t b, int32_t c, int32_t d);
+int32_t rtc_read (struct file_descriptor_t * fd, void * buf, int32_t nbytes);
 
 /* Sets the rate of periodic interrupts. */
-int32_t rtc_write (int32_t * buf, int32_t nbytes);
+int32_t rtc_write (struct file_descriptor_t * fd, const void * buf, int32_t nbytes);
+
+/* Programs the RTC's periodic interrupt rate in Hz. */
+int32_t rtc_set_frequency (int32_t freq);
 
 /* Opens the RTC. */
-int32_t rtc_open (void);
+int32_t rtc_open (struct file_descriptor_t * fd);
 
 /* Closes the RTC. */
-int32_t rtc_close (void);
+int32_t rtc_close (struct file_descriptor_t * fd);
 
 /* Redraws the screen from the appropriate video buffer */
 void update_vid( void );
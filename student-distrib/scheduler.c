@@ -5,36 +5,1314 @@
 #include "lib.h"
 #include "i8259.h"
 #include "syscalls.h"
+#include "process.h"
+#include "idt.h"
+#include "keyboard.h"
+#include "apic.h"
+#include "smp.h"
+#include "paging.h"
+#include "interrupthandler.h"
+#include "ktimer.h"
 
 
-uint32_t page_dir_addr1;
+
+/* 
+ * The boot processor's idle task stack. The idle tasks of the others run on
+ * a page smp_init allocates. Each processor keeps the rest of its state,
+ * ready queues included, in its cpu_t (see smp.h).
+ */
+uint8_t idle_stack[IDLE_STACK_SIZE] __attribute__((aligned (16)));
+
+/*
+ * Each processor has its ready queues (a run_queue_t), one per priority:
+ * every process waiting to run there, in the order they will run. Only 
+ * leaf processes that are not asleep are ever on them. A running process
+ * is not; it goes to the back of its queue when it is preempted. Bit p of
+ * the bitmap is set while the queue of priority p is not empty, so the 
+ * best priority with a process ready is found with a single bsf. A
+ * processor with nothing to run steals from the others.
+ */
+
+/* 
+ * The length of a time slice at each priority, in PIT ticks (30ms each).
+ * The default priority keeps the original single tick.
+ */
+const uint32_t priority_slice[NUM_PRIORITIES] = { 8, 6, 4, 2, 1, 1, 1, 1 };
+
+/*
+ * The real-time ready queue: periodic processes with budget left, linked
+ * through run_next and run_prev in order of their deadlines (earliest 
+ * deadline first). Everything on it runs before any normal process.
+ */
+pcb_t * rt_ready_head;
+
+/* The summed utilization of every periodic process, in thousandths. */
+uint32_t rt_utilization;
+
+/* 
+ * The number of ticks since the PIT was started, brought up to date from 
+ * the TSC by update_ticks, since the PIT no longer interrupts on each one.
+ */
+uint32_t sched_ticks;
+
+/* 
+ * The TSC calibration done by pit_init: TSC cycles per PIT count, per
+ * tick and per millisecond, nanoseconds per TSC cycle (shifted left by
+ * TSC_NS_SHIFT), and the TSC value at tick 0.
+ */
+uint32_t tsc_per_pit_count;
+uint32_t tsc_per_tick;
+uint32_t tsc_per_ms;
+uint32_t tsc_ns_mult;
+uint64_t tsc_boot;
+
+/* The last time sched_clock_ns returned, which it never goes back from. */
+uint64_t clock_last_ns;
+
+/* The local APIC timer mode in use, or APIC_TIMER_NONE while the PIT is. */
+uint32_t timer_mode;
+
+/* 
+ * The timer statistics since they were last printed: the number of timer
+ * interrupts, the cost of programming the timer, and how late interrupts
+ * came after the TSC value they were programmed for (the tick jitter), 
+ * all in TSC cycles.
+ */
+uint32_t timer_interrupts;
+uint32_t timer_programs;
+uint32_t timer_program_cycles;
+uint32_t timer_program_max_cycles;
+uint32_t timer_late_cycles;
+uint32_t timer_late_max_cycles;
+
+/* 
+ * The cost of the scheduling decisions made since the statistics were
+ * last printed, in TSC cycles.
+ */
+uint32_t sched_decisions;
+uint32_t sched_decision_cycles;
+uint32_t sched_decision_max_cycles;
+
+/* 
+ * The cost of the context switches made since the statistics were last
+ * printed, in TSC cycles (see switch_done).
+ */
+uint32_t sched_switches;
+uint32_t sched_switch_cycles;
+uint32_t sched_switch_max_cycles;
+
+
+
+
+/*
+ * is_foreground()
+ *
+ * Description:
+ * Tells whether a process runs on the terminal the user is looking at.
+ *
+ * Inputs: pcb - the process
+ * Retvals: 1 if it does, 0 otherwise
+ */
+static uint32_t is_foreground(pcb_t * pcb)
+{
+	return pcb->tty_number == get_active_terminal();
+}
+
+/*
+ * time_slice()
+ *
+ * Description:
+ * Returns the length of a fresh time slice for a process: the slice of
+ * its priority, stretched for processes on background terminals, which
+ * are there for throughput. The foreground gets its latency from being
+ * run as soon as it wakes instead.
+ *
+ * Inputs: pcb - the process
+ * Retvals: the slice, in PIT ticks
+ */
+static uint32_t time_slice(pcb_t * pcb)
+{
+	if( is_foreground(pcb) )
+	{
+		return priority_slice[pcb->priority];
+	}
+
+	return priority_slice[pcb->priority] * BACKGROUND_SLICE_FACTOR;
+}
+
+/*
+ * deadline_before()
+ *
+ * Description:
+ * Compares two deadlines, allowing for the tick count wrapping around.
+ *
+ * Inputs: a, b - the deadlines
+ * Retvals: 1 if a comes before b, 0 otherwise
+ */
+static uint32_t deadline_before(uint32_t a, uint32_t b)
+{
+	return (int32_t)(a - b) < 0;
+}
+
+/*
+ * rt_active()
+ *
+ * Description:
+ * Tells whether a process currently runs in the real-time class: it is
+ * periodic, and has budget left in this period. A periodic process that
+ * used up its budget runs as a normal process until its next period.
+ *
+ * Inputs: pcb - the process
+ * Retvals: 1 if it does, 0 otherwise
+ */
+static uint32_t rt_active(pcb_t * pcb)
+{
+	return pcb->rt.period != 0 && pcb->rt.budget_left > 0;
+}
+
+/*
+ * rt_update()
+ *
+ * Description:
+ * Starts a new period for a periodic process if its deadline has passed,
+ * counting a miss if it still had work pending, and refilling its budget.
+ *
+ * Inputs: pcb - the process
+ * Retvals: none
+ */
+static void rt_update(pcb_t * pcb)
+{
+	/* Local variables. */
+	uint32_t elapsed;
+
+	if( pcb->rt.period == 0 || deadline_before(sched_ticks, pcb->rt.deadline) )
+	{
+		return;
+	}
+
+	if( pcb->rt.pending )
+	{
+		pcb->rt.misses++;
+	}
+
+	elapsed = (sched_ticks - pcb->rt.deadline) / pcb->rt.period + 1;
+	pcb->rt.periods += elapsed;
+	pcb->rt.deadline += elapsed * pcb->rt.period;
+	pcb->rt.budget_left = pcb->rt.budget;
+}
+
+/*
+ * rt_insert()
+ *
+ * Description:
+ * Puts a real-time process on the real-time ready queue, behind every
+ * process with the same or an earlier deadline. This walks the queue,
+ * but it only ever holds the few periodic processes.
+ *
+ * Inputs: pcb - the process
+ * Retvals: none
+ */
+static void rt_insert(pcb_t * pcb)
+{
+	/* Local variables. */
+	pcb_t * prev = NULL;
+	pcb_t * next = rt_ready_head;
+
+	while( next != NULL && !deadline_before(pcb->rt.deadline, next->rt.deadline) )
+	{
+		prev = next;
+		next = next->run_next;
+	}
+
+	pcb->run_prev = prev;
+	pcb->run_next = next;
+	if( prev == NULL )
+	{
+		rt_ready_head = pcb;
+	}
+	else
+	{
+		prev->run_next = pcb;
+	}
+	if( next != NULL )
+	{
+		next->run_prev = pcb;
+	}
+
+	pcb->rt.queued = 1;
+}
+
+/*
+ * kick_idle_cpu()
+ *
+ * Description:
+ * Sends a reschedule interrupt to some other processor that is idle, so
+ * that it takes (steals) a process that has just become ready.
+ *
+ * Inputs: none
+ * Retvals: none
+ */
+static void kick_idle_cpu(void)
+{
+	/* Local variables. */
+	cpu_t * self = this_cpu();
+	uint32_t i;
+
+	for( i = 0; i < num_cpus; i++ )
+	{
+		if( &cpus[i] != self && cpus[i].online && cpus[i].idle_running )
+		{
+			apic_send_ipi(cpus[i].apic_id, RESCHED_INT);
+			return;
+		}
+	}
+}
+
+/*
+ * ready_insert()
+ *
+ * Description:
+ * Puts a process that can run on the ready queue of its priority, on the
+ * processor it last ran on, at the back or at the front, or on the 
+ * real-time ready queue (shared by all processors) if it is in the 
+ * real-time class. The caller makes sure it is not running, and not 
+ * already on a queue, and masks interrupts.
+ *
+ * Inputs: 
+ * pcb: the process
+ * at_front: 1 to run it before everything else of its priority
+ * Retvals: none
+ */
+static void ready_insert(pcb_t * pcb, uint32_t at_front)
+{
+	/* Local variables. */
+	run_queue_t * rq = &cpus[pcb->cpu].rq;
+
+	if( rt_active(pcb) )
+	{
+		rt_insert(pcb);
+	}
+	else
+	{
+		if( rq->head[pcb->priority] == NULL )
+		{
+			pcb->run_next = NULL;
+			pcb->run_prev = NULL;
+			rq->head[pcb->priority] = pcb;
+			rq->tail[pcb->priority] = pcb;
+		}
+		else if( at_front )
+		{
+			pcb->run_next = rq->head[pcb->priority];
+			pcb->run_prev = NULL;
+			rq->head[pcb->priority]->run_prev = pcb;
+			rq->head[pcb->priority] = pcb;
+		}
+		else
+		{
+			pcb->run_next = NULL;
+			pcb->run_prev = rq->tail[pcb->priority];
+			rq->tail[pcb->priority]->run_next = pcb;
+			rq->tail[pcb->priority] = pcb;
+		}
+
+		rq->bitmap |= (1 << pcb->priority);
+		rq->count++;
+	}
+
+	if( num_cpus > 1 )
+	{
+		kick_idle_cpu();
+	}
+}
+
+/*
+ * best_ready_priority()
+ *
+ * Description:
+ * Returns the best (lowest numbered) priority with a process ready on a
+ * processor.
+ *
+ * Inputs: rq - the processor's ready queues
+ * Retvals:
+ * NUM_PRIORITIES: no process is ready
+ * the priority otherwise
+ */
+static uint32_t best_ready_priority(run_queue_t * rq)
+{
+	/* Local variables. */
+	uint32_t priority;
+
+	if( rq->bitmap == 0 )
+	{
+		return NUM_PRIORITIES;
+	}
+
+	asm volatile("bsfl %1, %0":"=r"(priority):"rm"(rq->bitmap));
+	return priority;
+}
+
+/*
+ * ready_remove()
+ *
+ * Description:
+ * Takes a process off its ready queue.
+ *
+ * Inputs: pcb - the process, which must be on a queue
+ * Retvals: none
+ */
+static void ready_remove(pcb_t * pcb)
+{
+	/* Local variables. */
+	run_queue_t * rq = &cpus[pcb->cpu].rq;
+
+	if( pcb->rt.queued )
+	{
+		if( pcb->run_prev == NULL )
+		{
+			rt_ready_head = pcb->run_next;
+		}
+		else
+		{
+			pcb->run_prev->run_next = pcb->run_next;
+		}
+		if( pcb->run_next != NULL )
+		{
+			pcb->run_next->run_prev = pcb->run_prev;
+		}
+
+		pcb->run_next = NULL;
+		pcb->run_prev = NULL;
+		pcb->rt.queued = 0;
+		return;
+	}
+
+	if( pcb->run_prev == NULL )
+	{
+		rq->head[pcb->priority] = pcb->run_next;
+	}
+	else
+	{
+		pcb->run_prev->run_next = pcb->run_next;
+	}
+
+	if( pcb->run_next == NULL )
+	{
+		rq->tail[pcb->priority] = pcb->run_prev;
+	}
+	else
+	{
+		pcb->run_next->run_prev = pcb->run_prev;
+	}
+
+	if( rq->head[pcb->priority] == NULL )
+	{
+		rq->bitmap &= ~(1 << pcb->priority);
+	}
+	rq->count--;
+
+	pcb->run_next = NULL;
+	pcb->run_prev = NULL;
+}
+
+/*
+ * is_queued()
+ *
+ * Description:
+ * Tells whether a process is on one of the ready queues.
+ *
+ * Inputs: pcb - the process
+ * Retvals: 1 if it is, 0 otherwise
+ */
+static uint32_t is_queued(pcb_t * pcb)
+{
+	return pcb->rt.queued || pcb->run_prev != NULL || 
+	       cpus[pcb->cpu].rq.head[pcb->priority] == pcb;
+}
+
+/*
+ * busiest_cpu()
+ *
+ * Description:
+ * Finds the processor with the most processes waiting to run.
+ *
+ * Inputs: none
+ * Retvals:
+ * NULL: no processor has any
+ * the processor otherwise
+ */
+static cpu_t * busiest_cpu(void)
+{
+	/* Local variables. */
+	cpu_t * busiest = NULL;
+	uint32_t i;
+
+	for( i = 0; i < num_cpus; i++ )
+	{
+		if( cpus[i].rq.count > 0 && 
+		    (busiest == NULL || cpus[i].rq.count > busiest->rq.count) )
+		{
+			busiest = &cpus[i];
+		}
+	}
+
+	return busiest;
+}
+
+/*
+ * ready_dequeue()
+ *
+ * Description:
+ * Takes the real-time process with the earliest deadline off the 
+ * real-time ready queue or, if there is none, the process at the head of
+ * the best non-empty ready queue of this processor, giving it a fresh 
+ * time slice if it used up its last one. If this processor has nothing
+ * ready, the process is stolen from the processor with the most waiting,
+ * and runs here from then on.
+ *
+ * Inputs: cpu - this processor
+ * Retvals:
+ * NULL: every queue is empty
+ * the process otherwise
+ */
+static pcb_t * ready_dequeue(cpu_t * cpu)
+{
+	/* Local variables. */
+	cpu_t * victim = cpu;
+	uint32_t priority;
+	pcb_t * pcb;
+
+	if( rt_ready_head != NULL )
+	{
+		pcb = rt_ready_head;
+		ready_remove(pcb);
+		pcb->cpu = cpu->index;
+		return pcb;
+	}
+
+	if( cpu->rq.count == 0 )
+	{
+		victim = busiest_cpu();
+		if( victim == NULL )
+		{
+			return NULL;
+		}
+	}
+
+	priority = best_ready_priority(&victim->rq);
+	pcb = victim->rq.head[priority];
+	ready_remove(pcb);
+	pcb->cpu = cpu->index;
+	if( pcb->ticks_left == 0 )
+	{
+		pcb->ticks_left = time_slice(pcb);
+	}
+
+	return pcb;
+}
+
+/*
+ * has_work()
+ *
+ * Description:
+ * Tells whether there is any process this processor could run, its own or
+ * one to steal.
+ *
+ * Inputs: none
+ * Retvals: 1 if there is, 0 otherwise
+ */
+static uint32_t has_work(void)
+{
+	return rt_ready_head != NULL || busiest_cpu() != NULL;
+}
+
+/*
+ * should_preempt()
+ *
+ * Description:
+ * Tells whether the running process, which could keep running, should
+ * make way for a ready one. A real-time process only makes way for one
+ * with an earlier deadline. A normal process makes way for any real-time 
+ * process, and for a process of a better priority on its processor; for
+ * one of the same priority too if 'same' is set, which is only the case 
+ * once its slice is over or a focused process was woken. In the middle of
+ * a slice a process of the same priority has to wait its turn, or the
+ * slices of different lengths would not mean anything.
+ *
+ * Inputs: 
+ * pcb: the running process
+ * cpu: the processor it runs on
+ * same: whether a process of the same priority counts
+ * Retvals: 1 if it should, 0 otherwise
+ */
+static uint32_t should_preempt(pcb_t * pcb, cpu_t * cpu, uint32_t same)
+{
+	/* Local variables. */
+	uint32_t best;
+
+	if( rt_active(pcb) )
+	{
+		return rt_ready_head != NULL && 
+		       deadline_before(rt_ready_head->rt.deadline, pcb->rt.deadline);
+	}
+
+	if( rt_ready_head != NULL )
+	{
+		return 1;
+	}
+
+	best = best_ready_priority(&cpu->rq);
+	return best < pcb->priority || (same && best == pcb->priority);
+}
+
+/*
+ * units_to_tsc()
+ *
+ * Description:
+ * Finds the TSC value at which a count of ticks or milliseconds since 
+ * boot is reached. The counts wrap around at 32 bits, so the count is
+ * taken to be the one nearest the current time.
+ *
+ * Inputs:
+ * units: the count, modulo 2^32
+ * tsc_per_unit: TSC cycles per tick or millisecond
+ * Retvals: the TSC value
+ */
+static uint64_t units_to_tsc(uint32_t units, uint32_t tsc_per_unit)
+{
+	/* Local variables. */
+	uint64_t now = div64(rdtsc() - tsc_boot, tsc_per_unit);
+
+	now += (int32_t)(units - (uint32_t)now);
+	return tsc_boot + now * tsc_per_unit;
+}
+
+/*
+ * update_ticks()
+ *
+ * Description:
+ * Brings sched_ticks up to date by reading the TSC. It counts modulo 
+ * 2^32, like everything that compares ticks.
+ *
+ * Inputs: none
+ * Retvals: none
+ */
+static void update_ticks(void)
+{
+	if( tsc_per_tick != 0 )
+	{
+		sched_ticks = (uint32_t)div64(rdtsc() - tsc_boot, tsc_per_tick);
+	}
+}
+
+/*
+ * sched_now_ms()
+ *
+ * Description:
+ * Returns the milliseconds since the PIT was started, from the TSC. The
+ * kernel's timers (see ktimer.c) count in these, modulo 2^32, so the
+ * count wraps around after about 49 days.
+ *
+ * Inputs: none
+ * Retvals: the milliseconds since boot, modulo 2^32
+ */
+uint32_t sched_now_ms(void)
+{
+	if( tsc_per_ms == 0 )
+	{
+		return 0;
+	}
+
+	return (uint32_t)div64(rdtsc() - tsc_boot, tsc_per_ms);
+}
+
+/*
+ * sched_clock_ns()
+ *
+ * Description:
+ * Returns the nanoseconds since the PIT was started, from the TSC: the
+ * kernel's monotonic clock, for timestamps finer than a millisecond. The
+ * cycles are multiplied by tsc_ns_mult in two halves, so the product 
+ * does not overflow however long the system runs. The clock never goes
+ * backwards, even when read on processors whose TSCs disagree slightly.
+ *
+ * Inputs: none
+ * Retvals: the nanoseconds since boot
+ */
+uint64_t sched_clock_ns(void)
+{
+	/* Local variables. */
+	uint64_t cycles;
+	uint64_t ns;
+	uint32_t flags;
+
+	cycles = rdtsc() - tsc_boot;
+	ns = (((uint64_t)(uint32_t)(cycles >> 32) * tsc_ns_mult) << (32 - TSC_NS_SHIFT)) +
+	     (((uint64_t)(uint32_t)cycles * tsc_ns_mult) >> TSC_NS_SHIFT);
+
+	cli_and_save(flags);
+	if( ns < clock_last_ns )
+	{
+		ns = clock_last_ns;
+	}
+	clock_last_ns = ns;
+	restore_flags(flags);
+
+	return ns;
+}
+
+/*
+ * pit_program()
+ *
+ * Description:
+ * Programs a single PIT interrupt, 'count' PIT counts from now.
+ *
+ * Inputs: count - PIT_MIN_COUNT to PIT_MAX_COUNT
+ * Retvals: none
+ */
+static void pit_program(uint32_t count)
+{
+	outb(PIT_MODE0, PIT_CMDREG);
+	outb(count & 0xFF, PIT_CHANNEL0);
+	outb(count >> 8, PIT_CHANNEL0);
+}
+
+/*
+ * pit_stop()
+ *
+ * Description:
+ * Cancels the pending PIT interrupt, if any: in mode 0 the counter stops
+ * once the command is written, until it is given a new count.
+ *
+ * Inputs: none
+ * Retvals: none
+ */
+static void pit_stop(void)
+{
+	outb(PIT_MODE0, PIT_CMDREG);
+}
+
+/*
+ * timer_program()
+ *
+ * Description:
+ * Programs a single timer interrupt for when the TSC reaches 'target', on
+ * the local APIC timer or, failing that, on the PIT. The PIT can wait at
+ * most PIT_MAX_COUNT (about 55ms), so an event further away than that 
+ * takes more than one interrupt to reach.
+ *
+ * Inputs: target - the TSC value to interrupt at
+ * Retvals: none
+ */
+static void timer_program(uint64_t target)
+{
+	/* Local variables. */
+	uint64_t now;
+	uint32_t count;
+	uint32_t cycles;
+
+	now = rdtsc();
+
+	if( timer_mode != APIC_TIMER_NONE )
+	{
+		apic_timer_arm(target, now);
+	}
+	else
+	{
+		if( target <= now )
+		{
+			count = PIT_MIN_COUNT;
+		}
+		else if( target - now >= (uint64_t)(PIT_MAX_COUNT - 1) * tsc_per_pit_count )
+		{
+			count = PIT_MAX_COUNT;
+		}
+		else
+		{
+			/* Round up, so the interrupt comes just after the target, not before. */
+			count = div64_32(target - now, tsc_per_pit_count) + 1;
+			if( count < PIT_MIN_COUNT )
+			{
+				count = PIT_MIN_COUNT;
+			}
+		}
+
+		pit_program(count);
+		target = now + (uint64_t)count * tsc_per_pit_count;
+	}
+
+	this_cpu()->timer_target = target;
+
+	cycles = (uint32_t)(rdtsc() - now);
+	timer_programs++;
+	timer_program_cycles += cycles;
+	if( cycles > timer_program_max_cycles )
+	{
+		timer_program_max_cycles = cycles;
+	}
+}
+
+/*
+ * timer_stop()
+ *
+ * Description:
+ * Cancels the pending timer interrupt, if any.
+ *
+ * Inputs: none
+ * Retvals: none
+ */
+static void timer_stop(void)
+{
+	if( timer_mode != APIC_TIMER_NONE )
+	{
+		apic_timer_stop();
+	}
+	else
+	{
+		pit_stop();
+	}
+
+	this_cpu()->timer_target = TIMER_STOPPED;
+}
+
+/*
+ * ktimer_due()
+ *
+ * Description:
+ * Finds the TSC value at which the timer wheel next has something to do,
+ * for a processor's timer. Only the boot processor runs the wheel, so 
+ * the others never wait for it.
+ *
+ * Inputs:
+ * cpu: the processor
+ * target: filled in with the TSC value
+ * Retvals:
+ * -1: the processor has no kernel timer to wait for
+ * 0: success
+ */
+static int32_t ktimer_due(cpu_t * cpu, uint64_t * target)
+{
+	/* Local variables. */
+	uint32_t when;
+
+	if( cpu != &cpus[0] || tsc_per_ms == 0 || 0 != ktimer_next(&when) )
+	{
+		return -1;
+	}
+
+	*target = units_to_tsc(when, tsc_per_ms);
+	return 0;
+}
+
+/*
+ * arm_idle_timer()
+ *
+ * Description:
+ * Programs the timer of an idle processor: for the next kernel timer on
+ * the boot processor, if there is one, and not at all otherwise.
+ *
+ * Inputs: none
+ * Retvals: none
+ */
+static void arm_idle_timer(void)
+{
+	/* Local variables. */
+	uint64_t target;
+
+	if( 0 == ktimer_due(this_cpu(), &target) )
+	{
+		timer_program( target );
+	}
+	else
+	{
+		timer_stop();
+	}
+}
+
+/*
+ * arm_timer()
+ *
+ * Description:
+ * Programs the timer to interrupt when the next event of the running 
+ * process is due: the end of its time slice or, for a real-time process,
+ * the end of its budget or of its period, whichever comes first. On the
+ * boot processor, the next kernel timer may come before either.
+ *
+ * Inputs: pcb - the process about to run
+ * Retvals: none
+ */
+static void arm_timer(pcb_t * pcb)
+{
+	/* Local variables. */
+	uint32_t charged_ticks = this_cpu()->charged_ticks;
+	uint32_t ticks;
+	uint64_t target;
+	uint64_t wheel_target;
+
+	if( rt_active(pcb) )
+	{
+		ticks = pcb->rt.budget_left;
+		if( deadline_before(pcb->rt.deadline, charged_ticks + ticks) )
+		{
+			ticks = pcb->rt.deadline - charged_ticks;
+		}
+	}
+	else
+	{
+		ticks = pcb->ticks_left;
+	}
+
+	if( ticks == 0 )
+	{
+		ticks = 1;
+	}
+
+	target = units_to_tsc(charged_ticks + ticks, tsc_per_tick);
+	if( 0 == ktimer_due(this_cpu(), &wheel_target) && wheel_target < target )
+	{
+		target = wheel_target;
+	}
+
+	timer_program( target );
+}
+
+/*
+ * pit_wait()
+ *
+ * Description:
+ * Busy-waits for 'count' PIT counts on PIT channel 2, which counts down 
+ * once with its output polled through port 0x61. Used to calibrate other
+ * clocks; channel 0 and its interrupt are left alone.
+ *
+ * Inputs: count - 1 to PIT_MAX_COUNT
+ * Retvals: none
+ */
+void pit_wait(uint32_t count)
+{
+	/* Local variables. */
+	uint32_t gate;
+
+	/* Open channel 2's gate, keeping the speaker off. */
+	gate = inb(PIT_GATE_PORT);
+	outb((gate & ~PIT_SPEAKER) | PIT_GATE2, PIT_GATE_PORT);
+
+	outb(PIT_CH2_MODE0, PIT_CMDREG);
+	outb(count & 0xFF, PIT_CHANNEL2);
+	outb(count >> 8, PIT_CHANNEL2);
+
+	while( !(inb(PIT_GATE_PORT) & PIT_OUT2) );
+
+	outb(gate, PIT_GATE_PORT);
+}
+
+/*
+ * pit_calibrate_tsc()
+ *
+ * Description:
+ * Measures the TSC frequency against the PIT, over DIVISOR_100HZ (10ms),
+ * and works out the factors that turn TSC cycles into ticks, milliseconds
+ * and nanoseconds.
+ *
+ * Inputs: none
+ * Retvals: none
+ */
+static void pit_calibrate_tsc(void)
+{
+	/* Local variables. */
+	uint64_t start;
+	uint64_t cycles;
+
+	start = rdtsc();
+	pit_wait(DIVISOR_100HZ);
+	cycles = rdtsc() - start;
+
+	tsc_per_pit_count = div64_32(cycles, DIVISOR_100HZ);
+	if( tsc_per_pit_count == 0 )
+	{
+		tsc_per_pit_count = 1;
+	}
+	tsc_per_tick = div64_32(cycles * DIVISOR_33HZ, DIVISOR_100HZ);
+	tsc_per_ms = div64_32(cycles, MS_PER_CALIBRATION);
+	tsc_ns_mult = div64_32((uint64_t)NS_PER_CALIBRATION << TSC_NS_SHIFT, (uint32_t)cycles);
+}
+
+/*
+ * idle_task()
+ *
+ * Description:
+ * Runs, on its own stack, whenever no process can. It halts the processor
+ * until an interrupt comes in, and yields as soon as that interrupt has
+ * made some process runnable. The timer is stopped while it runs (except
+ * for the kernel's timers, on the boot processor), so only device 
+ * interrupts (or another processor's reschedule interrupt) wake the
+ * processor. Checking and halting happen with interrupts off up to the hlt
+ * (sti only takes effect after the next instruction), so a wake up cannot
+ * slip in between them. The kernel lock is let go of while it halts.
+ *
+ * Inputs: none
+ * Retvals: never returns
+ */
+static void idle_task(void)
+{
+	while( 1 )
+	{
+		cli();
+		if( !has_work() )
+		{
+			kernel_exit();
+			asm volatile("sti; hlt");
+			cli();
+			kernel_enter();
+		}
+		else
+		{
+			asm volatile("int %0"::"i"(YIELD_INT));
+		}
+	}
+}
+
+/*
+ * pit_init()
+ *
+ * Description:
+ * Initializes the PIT, and the scheduler's timer: the local APIC timer if
+ * there is one (calibrated against the PIT), the PIT otherwise. Either
+ * runs one-shot: each interrupt is programmed for the next event of the 
+ * running process (see arm_timer), and none at all while the system is 
+ * idle. Time is kept by the TSC, also calibrated here.
+ *
+ * Inputs: none
+ * Retvals: none
+ */
+void pit_init(void) 
+{
+	pit_calibrate_tsc();
+	tsc_boot = rdtsc();
+	sched_ticks = 0;
+	cpus[0].charged_ticks = 0;
+
+	timer_mode = apic_timer_init();
+	if( timer_mode != APIC_TIMER_NONE )
+	{
+		/* The PIT's interrupt stays masked; stop it counting as well. */
+		pit_stop();
+	}
+
+	/* Tick every 30 milliseconds until the first process runs. */
+	timer_program( tsc_boot + tsc_per_tick );
+
+	/* 
+	 * Give the idle task a stack frame that "returns" into idle_task the
+	 * first time the scheduler switches to it: the four registers and the
+	 * return address switch_to pops. It starts out holding the kernel lock
+	 * once, like the handler it returns into.
+	 */
+	cpus[0].idle_stack = idle_stack;
+	cpus[0].idle_ksp = (uint32_t)&idle_stack[IDLE_STACK_SIZE - SWITCH_FRAME_SIZE - 4];
+	memset((void *)cpus[0].idle_ksp, 0, SWITCH_FRAME_SIZE);
+	((uint32_t *)cpus[0].idle_ksp)[SWITCH_FRAME_RET] = (uint32_t)idle_task;
+	cpus[0].idle_lock_depth = 1;
+
+	/* Output from PIT channel 0 is connected to the PIC chip, so that it 
+	 * generates an "IRQ 0" */
+	if( timer_mode == APIC_TIMER_NONE )
+	{
+		enable_irq(PIT_IRQ);
+	}
+}
+
+/*
+ * sched_start_cpu()
+ *
+ * Description:
+ * Makes a processor that has just come online (see ap_main) idle, with
+ * the kernel lock held once, until there is a process for it to run.
+ *
+ * Inputs: none
+ * Retvals: never returns
+ */
+void sched_start_cpu(void)
+{
+	/* Local variables. */
+	cpu_t * cpu = this_cpu();
+
+	cli();
+	cpu->current = NULL;
+	cpu->idle_running = 1;
+	idle_task();
+}
+
+/*
+ * switch_done()
+ *
+ * Description:
+ * Called on the stack that has just been switched to, right after 
+ * switch_to returns into schedule, to count how long the switch took:
+ * from picking the next context (timer, page directory, TSS) to running
+ * on its stack.
+ *
+ * Inputs: none
+ * Retvals: none
+ */
+static void switch_done(void)
+{
+	/* Local variables. */
+	uint32_t cycles = (uint32_t)(rdtsc() - this_cpu()->switch_start);
+
+	sched_switches++;
+	sched_switch_cycles += cycles;
+	if( cycles > sched_switch_max_cycles )
+	{
+		sched_switch_max_cycles = cycles;
+	}
+}
+
+/*
+ * schedule()
+ *
+ * Description:
+ * Switches to the real-time process with the earliest deadline or, if 
+ * there is none, the first process of the best priority that has one 
+ * ready, or to the idle task if nothing is ready and the current process 
+ * cannot run. Picking a normal process is O(1), whatever the number of 
+ * processes. The timer is then programmed for the next event of the 
+ * process that runs, or stopped for the idle task. Each processor 
+ * schedules for itself, stealing from the others when it has nothing of
+ * its own. Must be the last thing an interrupt handler does, with 
+ * interrupts masked and the kernel lock held: the switched out context is
+ * resumed later by returning from switch_to, then from this same function
+ * into that handler, which then restores the registers saved by its asm
+ * wrapper. The depth the lock is held at goes with the context. CR3 is 
+ * only written when the address space changes.
+ *
+ * Inputs: none
+ * Retvals: none
+ */
+static void schedule(void)
+{
+	/* Local variables */
+	cpu_t * cpu = this_cpu();
+	pcb_t * process_control_block;
+	pcb_t * next_pcb;
+	uint32_t * prev_ksp;
+	uint64_t start;
+	uint32_t cycles;
+	
+	process_control_block = cpu->current;
+	if( process_control_block == NULL && !cpu->idle_running )
+	{
+		return;
+	}
+	
+	start = rdtsc();
+	cpu->need_resched = 0;
+	update_ticks();
+	
+	/* 
+	 * Find the next process to be scheduled. A preempted process that can
+	 * still run goes back on its queue, unless nothing should preempt it,
+	 * in which case it simply keeps running (with a fresh slice if it used
+	 * up the last one).
+	 */
+	if( !cpu->idle_running && process_control_block->state == TASK_RUNNABLE &&
+	    !should_preempt(process_control_block, cpu, 1) )
+	{
+		next_pcb = process_control_block;
+		if( next_pcb->ticks_left == 0 )
+		{
+			next_pcb->ticks_left = time_slice(next_pcb);
+		}
+	}
+	else
+	{
+		if( !cpu->idle_running && process_control_block->state == TASK_RUNNABLE )
+		{
+			ready_enqueue( process_control_block );
+		}
+		next_pcb = ready_dequeue(cpu);
+	}
+	
+	cycles = (uint32_t)(rdtsc() - start);
+	sched_decisions++;
+	sched_decision_cycles += cycles;
+	if( cycles > sched_decision_max_cycles )
+	{
+		sched_decision_max_cycles = cycles;
+	}
+	
+	if( cpu->idle_running )
+	{
+		/* Keep idling until something can run. */
+		if( next_pcb == NULL )
+		{
+			arm_idle_timer();
+			return;
+		}
+		
+		prev_ksp = &cpu->idle_ksp;
+		cpu->idle_lock_depth = cpu->lock_depth;
+		cpu->idle_running = 0;
+	}
+	else
+	{
+		/* Keep running the current process if nothing else is ready. */
+		if( next_pcb == process_control_block )
+		{
+			arm_timer( next_pcb );
+			return;
+		}
+		
+		prev_ksp = &process_control_block->ksp_before_change;
+		process_control_block->lock_depth = cpu->lock_depth;
+		
+		/* Set the process_term_number in lib.c so that the display functions know where to write */
+		set_process_term_number( process_control_block->tty_number );
+		
+		/* 
+		 * Nothing can run: switch to the idle task. With other 
+		 * processors, it runs on the kernel's own page directory, since
+		 * the process switched out may run on one of them, and exit 
+		 * there, meanwhile. With none, the process's directory stays
+		 * loaded, in case it is the next to run again.
+		 */
+		if( next_pcb == NULL )
+		{
+			arm_idle_timer();
+			cpu->idle_running = 1;
+			set_current_pcb( NULL );
+			if( num_cpus > 1 )
+			{
+				switch_page_directory( &page_directories[0] );
+			}
+			cpu->lock_depth = cpu->idle_lock_depth;
+			cpu->switch_start = rdtsc();
+			switch_to( prev_ksp, cpu->idle_ksp );
+			switch_done();
+			return;
+		}
+	}
+	
+	
+	/* The next process is charged from now on, until its next event. */
+	cpu->switch_start = rdtsc();
+	cpu->charged_ticks = sched_ticks;
+	arm_timer( next_pcb );
+	
+	/* Load the page directory of the next process, which becomes the current process. */
+	switch_page_directory( next_pcb->page_directory );
+	set_current_pcb( next_pcb );
+	cpu->lock_depth = next_pcb->lock_depth;
+	
+	
+	/* Set the kernel_stack_bottom and the TSS to point to the next process's kernel stack. */
+	set_kernel_stack_bottom( KERNEL_STACK_BOTTOM( next_pcb ) );
+	
+
+	/* 
+	 * Switch to the stack of the next process (now-current process). Remember that this
+	 * stack was where that process itself last called switch_to, here, from the PIT, yield, keyboard or 
+	 * RTC interrupt handler. switch_to returns there, and this function then returns into that handler, 
+	 * which returns to its asm wrapper, which can then iret, resuming the now-current process. Nothing
+	 * after the switch may use 'cpu': the process may have been switched out on another processor.
+	 */
+	switch_to( prev_ksp, next_pcb->ksp_before_change );
+	switch_done();
+}
 
 /*
- * pit_init()
+ * timer_interruption()
  *
  * Description:
- * Initializes the PIT.
+ * The body of the PIT and local APIC timer interrupt handlers. Runs the
+ * kernel's timers that are due, on the boot processor. Charges the ticks that passed since it
+ * was last charged to the running process, and invokes process scheduling
+ * action once its time slice (or real-time budget) is used up or a process
+ * that should preempt it is ready. Otherwise the timer is programmed for
+ * its next event again, since it only interrupts once at a time.
  *
  * Inputs: none
  * Retvals: none
  */
-void pit_init(void) 
+static void timer_interruption(void)
 {
-	/* Set frequency to 33HZ (interrupt every 30 milliseconds). */
-    outb(PIT_MODE3, PIT_CMDREG);
-    outb(DIVISOR_33HZ & 0xFF, PIT_CHANNEL0);
-    outb(DIVISOR_33HZ >> 8, PIT_CHANNEL0);
-
-	/* Output from PIT channel 0 is connected to the PIC chip, so that it 
-	 * generates an "IRQ 0" */
-	enable_irq(PIT_IRQ);
+	/* Local variables */
+	cpu_t * cpu = this_cpu();
+	pcb_t * process_control_block;
+	uint32_t elapsed;
+	uint64_t now;
+	uint32_t late;
+	
+	now = rdtsc();
+	late = now > cpu->timer_target ? (uint32_t)(now - cpu->timer_target) : 0;
+	timer_interrupts++;
+	timer_late_cycles += late;
+	if( late > timer_late_max_cycles )
+	{
+		timer_late_max_cycles = late;
+	}
+	
+	update_ticks();
+	
+	if( cpu == &cpus[0] )
+	{
+		ktimer_run( sched_now_ms() );
+	}
+	
+	process_control_block = cpu->current;
+	if( process_control_block == NULL && !cpu->idle_running )
+	{
+		/* No process has started yet: keep ticking. */
+		cpu->charged_ticks = sched_ticks;
+		timer_program( units_to_tsc(sched_ticks + 1, tsc_per_tick) );
+		return;
+	}
+	
+	if( !cpu->idle_running )
+	{
+		elapsed = sched_ticks - cpu->charged_ticks;
+		cpu->charged_ticks = sched_ticks;
+		
+		rt_update( process_control_block );
+		
+		if( rt_active(process_control_block) )
+		{
+			if( elapsed > process_control_block->rt.budget_left )
+			{
+				elapsed = process_control_block->rt.budget_left;
+			}
+			process_control_block->rt.budget_left -= elapsed;
+			if( process_control_block->rt.budget_left > 0 && 
+			    !should_preempt(process_control_block, cpu, 0) )
+			{
+				arm_timer( process_control_block );
+				return;
+			}
+		}
+		else
+		{
+			if( elapsed > process_control_block->ticks_left )
+			{
+				elapsed = process_control_block->ticks_left;
+			}
+			process_control_block->ticks_left -= elapsed;
+			
+			if( process_control_block->ticks_left > 0 && 
+			    !should_preempt(process_control_block, cpu, 0) )
+			{
+				arm_timer( process_control_block );
+				return;
+			}
+		}
+	}
+	
+	schedule();
 }
 
 /*
  * pit_interruption()
  *
  * Description:
- * The handler for an PIT interrupt. Invokes process scheduling action.
+ * The handler for an PIT interrupt.
  *
  * Inputs: none
  * Retvals: none
@@ -47,118 +1325,516 @@ void pit_interruption(void)
 	/* Send EOI, otherwise we freeze up. */
 	send_eoi(PIT_IRQ);
 	
+	timer_interruption();
+}
+
+/*
+ * apic_timer_interruption()
+ *
+ * Description:
+ * The handler for a local APIC timer interrupt.
+ *
+ * Inputs: none
+ * Retvals: none
+ */
+void apic_timer_interruption(void)
+{
+	/* Mask interrupts */
+	cli();
+
+	apic_eoi();
 	
+	timer_interruption();
+}
+
+/*
+ * sched_preempt()
+ *
+ * Description:
+ * Called by interrupt handlers that wake processes up, as the last thing
+ * they do and with interrupts masked. If a process on the focused terminal
+ * or a real-time process was woken, it is switched to now instead of at 
+ * the next PIT tick (as long as the running process should make way).
+ *
+ * Inputs: none
+ * Retvals: none
+ */
+void sched_preempt(void)
+{
+	if( this_cpu()->need_resched )
+	{
+		schedule();
+	}
+}
+
+/*
+ * resched_interruption()
+ *
+ * Description:
+ * The handler for the reschedule interrupt another processor sends when
+ * it makes a process ready while this one idles (see kick_idle_cpu).
+ *
+ * Inputs: none
+ * Retvals: none
+ */
+void resched_interruption(void)
+{
+	/* Mask interrupts */
+	cli();
+
+	apic_eoi();
+
+	this_cpu()->need_resched = 1;
+	sched_preempt();
+}
+
+/*
+ * sched_ktimer_added()
+ *
+ * Description:
+ * Called by ktimer_add once a timer has been added, with interrupts 
+ * masked. If the boot processor's timer is set for later than the timer 
+ * wheel now needs it, it is programmed again: here, or, from another
+ * processor, by sending the boot processor a reschedule interrupt (the
+ * scheduler programs the timer whenever it runs).
+ *
+ * Inputs: none
+ * Retvals: none
+ */
+void sched_ktimer_added(void)
+{
+	/* Local variables. */
+	cpu_t * boot_cpu = &cpus[0];
+	uint64_t target;
+
+	if( 0 != ktimer_due(boot_cpu, &target) || target >= boot_cpu->timer_target )
+	{
+		return;
+	}
+
+	if( this_cpu() == boot_cpu )
+	{
+		timer_program( target );
+	}
+	else
+	{
+		apic_send_ipi(boot_cpu->apic_id, RESCHED_INT);
+	}
+}
+
+/*
+ * yield_interruption()
+ *
+ * Description:
+ * The handler for the kernel's yield interrupt (int 0x81), raised by a
+ * process that has just blocked, or by the idle task once some process
+ * can run. Going through an interrupt lets the process be switched out
+ * exactly like a preempted one, with all its registers saved.
+ *
+ * Inputs: none
+ * Retvals: none
+ */
+void yield_interruption(void)
+{
+	schedule();
+}
+
+/*
+ * sleep_on()
+ *
+ * Description:
+ * Blocks the current process on a wait queue and gives up the processor.
+ * It is not scheduled again until wake_up is called on the queue. Callers
+ * must mask interrupts before testing the condition they wait for, and
+ * test it again once this returns, as in:
+ *     cli_and_save(flags);
+ *     while( !condition ) sleep_on(&queue);
+ *     restore_flags(flags);
+ * Interrupts are still masked when this returns.
+ *
+ * Inputs: queue - the queue to wait on
+ * Retvals: none
+ */
+void sleep_on(wait_queue_t * queue)
+{
 	/* Local variables */
-	int i;
-	pcb_t * process_control_block;
+	pcb_t * process_control_block = get_current_pcb();
+	
+	process_control_block->state = TASK_BLOCKED;
+	process_control_block->rt.pending = 0;
+	process_control_block->wait_next = queue->head;
+	queue->head = process_control_block;
 	
-	uint8_t running_processes = get_running_processes();
-	uint8_t current_process_number = get_current_process_number();
+	asm volatile("int %0"::"i"(YIELD_INT));
+}
+
+/*
+ * wake_up()
+ *
+ * Description:
+ * Makes every process on a wait queue runnable again and empties the
+ * queue. Safe to call from interrupt handlers. Real-time processes, and
+ * processes on the focused terminal (which go to the front of their ready
+ * queue), ask to preempt the running process (see sched_preempt); the 
+ * others just join the back of their queue.
+ *
+ * Inputs: queue - the queue to wake
+ * Retvals: none
+ */
+void wake_up(wait_queue_t * queue)
+{
+	/* Local variables */
+	pcb_t * process_control_block;
+	uint32_t flags;
 	
+	cli_and_save(flags);
+	update_ticks();
 	
-	/* Find the next process to be scheduled */
-	uint8_t next_process_number = (current_process_number+1) % 8;
-	uint8_t bitmask = 0x80;
-	for( i = 0; i < next_process_number; i++ )
-	{
-		bitmask >>= 1;
-	}
-	while( next_process_number != current_process_number )
+	while( queue->head != NULL )
 	{
-		/* Check to see if the process number is running (but don't look at 
-		 * process #0, aka "no process running") 
-		 */
-		if( bitmask & (running_processes & 0x7F) )
+		process_control_block = queue->head;
+		queue->head = process_control_block->wait_next;
+		process_control_block->wait_next = NULL;
+		process_control_block->state = TASK_RUNNABLE;
+		
+		/* A periodic process has work to do again. */
+		rt_update( process_control_block );
+		if( process_control_block->rt.period != 0 )
 		{
-			/* Extract the PCB from the process number */
-			process_control_block = (pcb_t *)( _8MB - (_8KB)*(next_process_number + 1) );
-			
-			/* If the current process does not have a child, it is a "leaf" process,
-			 * and we want to run it.
-			 */
-			if( !process_control_block->has_child )
-			{
-				break;
-			}
+			process_control_block->rt.pending = 1;
 		}
 		
-		next_process_number = (next_process_number+1) % 8;
-		bitmask >>= 1;
-		if( bitmask == 0 )
+		if( rt_active(process_control_block) )
+		{
+			ready_insert( process_control_block, 0 );
+			this_cpu()->need_resched = 1;
+		}
+		else if( is_foreground(process_control_block) )
+		{
+			/* Run it here, where it can preempt right away. */
+			process_control_block->cpu = this_cpu()->index;
+			ready_insert( process_control_block, 1 );
+			this_cpu()->need_resched = 1;
+		}
+		else
 		{
-			bitmask = 0x80;
+			ready_insert( process_control_block, 0 );
 		}
 	}
 	
-	/* If we didn't find another process to schedule, return */
-	if( current_process_number == next_process_number )
+	restore_flags(flags);
+}
+
+/*
+ * ready_enqueue()
+ *
+ * Description:
+ * Puts a process that can run at the back of the ready queue of its 
+ * priority. The caller makes sure it is not running, and not already on 
+ * a queue.
+ *
+ * Inputs: pcb - the process
+ * Retvals: none
+ */
+void ready_enqueue(pcb_t * pcb)
+{
+	/* Local variables */
+	uint32_t flags;
+	
+	cli_and_save(flags);
+	ready_insert( pcb, 0 );
+	restore_flags(flags);
+}
+
+/*
+ * sched_set_priority()
+ *
+ * Description:
+ * Changes the priority of a process, moving it to its new ready queue if 
+ * it is waiting on one. A running process keeps its current slice, cut
+ * down to the length of a slice at the new priority.
+ *
+ * Inputs: 
+ * pcb: the process
+ * priority: PRIORITY_HIGHEST to PRIORITY_LOWEST
+ * Retvals:
+ * -1: bad priority
+ * 0: success
+ */
+int32_t sched_set_priority(pcb_t * pcb, uint32_t priority)
+{
+	/* Local variables */
+	uint32_t flags;
+	uint32_t queued;
+	
+	if( priority > PRIORITY_LOWEST )
+	{
+		return -1;
+	}
+	
+	cli_and_save(flags);
+	
+	queued = is_queued( pcb );
+	if( queued )
 	{
-		return;
+		ready_remove( pcb );
+	}
+	
+	pcb->priority = priority;
+	if( pcb->ticks_left > time_slice(pcb) )
+	{
+		pcb->ticks_left = time_slice(pcb);
+	}
+	
+	if( queued )
+	{
+		ready_enqueue( pcb );
 	}
 	
-	/* Extract the PCB from the process number */
-	process_control_block = (pcb_t *)( _8MB - (_8KB)*(current_process_number + 1) );
+	restore_flags(flags);
+	return 0;
+}
+
+/*
+ * sched_set_periodic()
+ *
+ * Description:
+ * Puts a process in the periodic real-time class: in every period it may
+ * run for up to 'budget_ms' ahead of all normal processes, dispatched 
+ * earliest deadline first, the deadline being the end of the period. A 
+ * period that ends while the process still has work pending (it has not
+ * blocked since it last woke up) counts as a deadline miss. Both times
+ * are rounded up to whole PIT ticks, and then the budget must be shorter
+ * than the period, and the utilization of every periodic process together
+ * must stay within RT_UTIL_MAX; otherwise nothing changes. A period of 0
+ * makes the process a normal one again.
+ *
+ * Inputs: 
+ * pcb: the process, which must be the running one
+ * period_ms: the length of each period, or 0
+ * budget_ms: the run time allowed in each period
+ * Retvals:
+ * -1: the budget is 0 or not shorter than the period, or the processor
+ *     time is already taken
+ * 0: success
+ */
+int32_t sched_set_periodic(pcb_t * pcb, uint32_t period_ms, uint32_t budget_ms)
+{
+	/* Local variables */
+	uint32_t flags;
+	uint32_t period = 0;
+	uint32_t budget = 0;
+	uint32_t util = 0;
+	
+	if( period_ms != 0 )
+	{
+		period = (period_ms + MS_PER_TICK - 1) / MS_PER_TICK;
+		budget = (budget_ms + MS_PER_TICK - 1) / MS_PER_TICK;
+		if( budget == 0 || budget >= period )
+		{
+			return -1;
+		}
+		util = (budget * RT_UTIL_SCALE + period - 1) / period;
+	}
 	
-	/* Store the %ESP as "ksp_before_change" in the PCB of the current process. */
-	uint32_t esp;
-	asm volatile("movl %%esp, %0":"=g"(esp));
-	process_control_block->ksp_before_change = esp;
+	cli_and_save(flags);
 	
-	/* Store the %EBP as "kbp_before_change" in the PCB of the current process. */
-	uint32_t ebp;
-	asm volatile("movl %%ebp, %0":"=g"(ebp));
-	process_control_block->kbp_before_change = ebp;
+	if( rt_utilization - pcb->rt.util + util > RT_UTIL_MAX )
+	{
+		restore_flags(flags);
+		return -1;
+	}
+	rt_utilization = rt_utilization - pcb->rt.util + util;
 	
+	update_ticks();
+	memset( &pcb->rt, 0, sizeof(rt_task_t) );
+	if( period_ms != 0 )
+	{
+		pcb->rt.period = period;
+		pcb->rt.budget = budget;
+		pcb->rt.util = util;
+		pcb->rt.budget_left = pcb->rt.budget;
+		pcb->rt.deadline = sched_ticks + pcb->rt.period;
+		pcb->rt.pending = 1;
+	}
 	
-	/* Set the current process to the next process */
-	current_process_number = next_process_number;
-	set_current_process_number(next_process_number);
+	restore_flags(flags);
+	return 0;
+}
+
+/*
+ * sched_get_rt_stats()
+ *
+ * Description:
+ * Fills in the real-time statistics of a process, bringing its period 
+ * up to date first.
+ *
+ * Inputs: 
+ * pcb: the process
+ * stats: where to put the statistics
+ * Retvals: none
+ */
+void sched_get_rt_stats(pcb_t * pcb, rt_stats_t * stats)
+{
+	/* Local variables */
+	uint32_t flags;
 	
+	cli_and_save(flags);
 	
-	/* Set the process_term_number in lib.c so that the display functions know where to write */
-	set_process_term_number( process_control_block->tty_number );
+	update_ticks();
+	rt_update( pcb );
+	stats->period_ms = pcb->rt.period * MS_PER_TICK;
+	stats->budget_ms = pcb->rt.budget * MS_PER_TICK;
+	stats->periods = pcb->rt.periods;
+	stats->deadline_misses = pcb->rt.misses;
 	
+	restore_flags(flags);
+}
+
+/*
+ * sched_print_stats()
+ *
+ * Description:
+ * Prints how many scheduling decisions were made since the last call and
+ * what they cost, and the timer's interrupts, programming cost and 
+ * jitter, then starts counting again. Calling it with different
+ * numbers of processes shows the cost does not grow with the count.
+ * CTRL + S calls it (see process_keyboard_input).
+ *
+ * Inputs: none
+ * Retvals: none
+ */
+void sched_print_stats(void)
+{
+	/* Local variables */
+	uint32_t average = 0;
+	uint32_t program_average = 0;
+	uint32_t late_average = 0;
+	uint32_t switch_average = 0;
+	uint32_t flags;
 	
-	/* Load the page directory of the next process. */
-	set_page_dir_addr( (uint32_t)(&page_directories[next_process_number]) );
-	page_dir_addr1 = (uint32_t)(&page_directories[next_process_number]);
-	asm (
-	"movl page_dir_addr1, %%eax       ;"
-	"andl $0xFFFFFFE7, %%eax          ;"
-	"movl %%eax, %%cr3                ;"
-	"movl %%cr4, %%eax                ;"
-	"orl $0x00000090, %%eax           ;"
-	"movl %%eax, %%cr4                ;"
-	"movl %%cr0, %%eax                ;"
-	"orl $0x80000000, %%eax 	      ;"
-	"movl %%eax, %%cr0                 "
-	: : : "eax", "cc" );
+	cli_and_save(flags);
 	
+	if( sched_decisions != 0 )
+	{
+		average = sched_decision_cycles / sched_decisions;
+	}
 	
-	/* Set the kernel_stack_bottom and the TSS to point to the next process's kernel stack. */
-	tss.esp0 = _8MB - (_8KB)*next_process_number - 4;
-	set_kernel_stack_bottom( _8MB - (_8KB)*next_process_number - 4 );
+	printf("scheduler: %d decisions, %d cycles average, %d cycles max, %d processes, %d processors\n",
+	       sched_decisions, average, sched_decision_max_cycles, process_count(), num_cpus);
 	
+	if( timer_programs != 0 )
+	{
+		program_average = timer_program_cycles / timer_programs;
+	}
+	if( timer_interrupts != 0 )
+	{
+		late_average = timer_late_cycles / timer_interrupts;
+	}
 	
-	/* Extract the PCB from the process number */
-	process_control_block = (pcb_t *)( _8MB - (_8KB)*(next_process_number + 1) );
+	if( sched_switches != 0 )
+	{
+		switch_average = sched_switch_cycles / sched_switches;
+	}
 	
+	printf("switch: %d switches, %d cycles average, %d cycles max\n",
+	       sched_switches, switch_average, sched_switch_max_cycles);
+	printf("timer: %s, %d interrupts, tick %d\n", 
+	       timer_mode == APIC_TIMER_DEADLINE ? "apic tsc-deadline" :
+	       timer_mode == APIC_TIMER_ONESHOT ? "apic one-shot" : "pit one-shot",
+	       timer_interrupts, sched_ticks);
+	printf("timer: %d programs, %d cycles average, %d cycles max\n",
+	       timer_programs, program_average, timer_program_max_cycles);
+	printf("timer: %d cycles late average, %d cycles late max\n",
+	       late_average, timer_late_max_cycles);
 	
-	/* Put the "ksp_before_change" of the next process into the %ESP. */
-	asm volatile("movl %0, %%esp	;"
-				 ::"g"(process_control_block->ksp_before_change));
-				 
-	/* Put the "kbp_before_change" of the next process into the %EBP. */
-	asm volatile("movl %0, %%ebp"::"g"(process_control_block->kbp_before_change));
+	timer_interrupts = 0;
+	timer_programs = 0;
+	timer_program_cycles = 0;
+	timer_program_max_cycles = 0;
+	timer_late_cycles = 0;
+	timer_late_max_cycles = 0;
+	sched_decisions = 0;
+	sched_decision_cycles = 0;
+	sched_decision_max_cycles = 0;
+	sched_switches = 0;
+	sched_switch_cycles = 0;
+	sched_switch_max_cycles = 0;
 	
+	restore_flags(flags);
+}
 
-	/* 
-	 * We have now switched to the stack of the next process (now-current process). Remember that this
-	 * stack was where we originally called 'change_process' for this process. Thus, the current stack 
-	 * contains the appropriate data that was pushed when we made the 'change_process' syscall for the 
-	 * now-current process. If we now leave and ret, we will return back to the syscall_handler for the 
-	 * original 'change_process' syscall, which can then iret, resuming the now-current process.
-	 */
-	asm volatile("leave");
-	asm volatile("ret");
+#ifdef BENCHMARK
+/* The stack of sched_bench's partner, and both sides' saved stack pointers. */
+static uint8_t bench_stack[IDLE_STACK_SIZE] __attribute__((aligned (16)));
+static uint32_t bench_ksp;
+static uint32_t bench_main_ksp;
+
+/* Whether the partner loads CR3 on each of its switches too. */
+static uint32_t bench_reload_cr3;
+
+/*
+ * sched_bench_partner()
+ *
+ * Description:
+ * The other side of sched_bench: switches straight back, forever.
+ *
+ * Inputs: none
+ * Retvals: never returns
+ */
+static void sched_bench_partner(void)
+{
+	while( 1 )
+	{
+		if( bench_reload_cr3 )
+		{
+			load_page_directory( &page_directories[0] );
+		}
+		switch_to( &bench_ksp, bench_main_ksp );
+	}
+}
+
+/*
+ * sched_bench()
+ *
+ * Description:
+ * Microbenchmark for the context switch. Switches back and forth between
+ * two kernel stacks SCHED_BENCH_ITERATIONS times with switch_to alone, 
+ * which is what schedule does when the address space stays the same, and
+ * again with a CR3 load on every switch (the same directory, so only the
+ * cost of the load and TLB flush shows), and prints the average cost of
+ * one switch of each kind in cycles.
+ *
+ * Inputs: none
+ * Retvals: none
+ */
+void sched_bench(void)
+{
+	/* Local variables. */
+	uint64_t start;
+	uint32_t bare, with_cr3;
+	uint32_t i;
+
+	bench_ksp = (uint32_t)&bench_stack[IDLE_STACK_SIZE - SWITCH_FRAME_SIZE - 4];
+	memset((void *)bench_ksp, 0, SWITCH_FRAME_SIZE);
+	((uint32_t *)bench_ksp)[SWITCH_FRAME_RET] = (uint32_t)sched_bench_partner;
+
+	bench_reload_cr3 = 0;
+	start = rdtsc();
+	for( i = 0; i < SCHED_BENCH_ITERATIONS; i++ )
+		switch_to( &bench_main_ksp, bench_ksp );
+	bare = (uint32_t)(rdtsc() - start) / (2 * SCHED_BENCH_ITERATIONS);
+
+	bench_reload_cr3 = 1;
+	start = rdtsc();
+	for( i = 0; i < SCHED_BENCH_ITERATIONS; i++ )
+	{
+		load_page_directory( &page_directories[0] );
+		switch_to( &bench_main_ksp, bench_ksp );
+	}
+	with_cr3 = (uint32_t)(rdtsc() - start) / (2 * SCHED_BENCH_ITERATIONS);
+
+	printf("context switch (cycles/switch): switch_to %u, with CR3 load %u\n",
+	       bare, with_cr3);
 }
+#endif /* BENCHMARK */
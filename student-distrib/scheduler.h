@@ -5,25 +5,166 @@
 #define SCHEDULER_H
 
 
+
+#include "types.h"
+
+
 /* PIT Chip's Command Register Port */
 #define PIT_CMDREG        0x43
 
 /* PIT Channel 0's Data Register Port */
 #define PIT_CHANNEL0      0x40
 
+/* PIT Channel 2's Data Register Port */
+#define PIT_CHANNEL2      0x42
+
+/* The port holding channel 2's gate and output (shared with the speaker). */
+#define PIT_GATE_PORT     0x61
+#define PIT_GATE2         0x01
+#define PIT_SPEAKER       0x02
+#define PIT_OUT2          0x20
+
 /* Divisors for PIT Frequency setting 
  * DIVISOR_???HZ = 1193180 / HZ;  
  */
 #define DIVISOR_100HZ	11932
 #define DIVISOR_33HZ	36157
 #define DIVISOR_20HZ	59659
+#define PIT_COUNTS_200US	239
+
+/* The TSC is calibrated over DIVISOR_100HZ PIT counts: 10 milliseconds. */
+#define MS_PER_CALIBRATION	10
+#define NS_PER_CALIBRATION	10000000
+#define NS_PER_SEC		1000000000
 
-/* Pit Mode 3 */
-#define PIT_MODE3		0x36
+/* 
+ * TSC cycles are turned into nanoseconds by multiplying by a fixed point
+ * factor with this many fraction bits (enough for a TSC of 4MHz up).
+ */
+#define TSC_NS_SHIFT	24
+
+/* The clocks clock_gettime can read. */
+#define CLOCK_MONOTONIC	1
+
+/* A processor's timer_target while its timer is stopped. */
+#define TIMER_STOPPED	0xFFFFFFFFFFFFFFFFULL
+
+/* Pit Mode 0 (one-shot: interrupt once when the count runs out), channel 0 and channel 2 */
+#define PIT_MODE0		0x30
+#define PIT_CH2_MODE0	0xB0
+
+/* The shortest and longest counts a one-shot is programmed with. */
+#define PIT_MIN_COUNT	2
+#define PIT_MAX_COUNT	0xFFFF
 
 /* IRQ Constant. */
 #define PIT_IRQ			0
 
+/* Scheduling priorities: lower numbers run first, and get longer slices. */
+#define NUM_PRIORITIES		8
+#define PRIORITY_HIGHEST	0
+#define PRIORITY_DEFAULT	4
+#define PRIORITY_LOWEST		(NUM_PRIORITIES - 1)
+
+/* 
+ * Time slices and real-time periods are counted in ticks of DIVISOR_33HZ
+ * PIT counts, about 30ms each, although the PIT no longer interrupts on 
+ * every tick.
+ */
+#define MS_PER_TICK		30
+
+/*
+ * Real-time utilization (budget / period) is counted in thousandths. All
+ * the periodic processes together may use at most RT_UTIL_MAX of it, so
+ * EDF can meet their deadlines and normal processes still get the rest.
+ */
+#define RT_UTIL_SCALE	1000
+#define RT_UTIL_MAX		700
+
+/* How much longer the slices of processes on background terminals are. */
+#define BACKGROUND_SLICE_FACTOR	4
+
+/* The size of the idle task's stack. */
+#define IDLE_STACK_SIZE	_4KB
+#define SCHED_BENCH_ITERATIONS  10000
+
+
+
+struct pcb_t;
+
+/* Explanation:
+ * A list of processes blocked until some event happens, linked through
+ * their PCBs' wait_next fields.
+ *    head -- The first process waiting, or NULL.
+ */
+typedef struct wait_queue_t {
+	struct pcb_t * head;
+} wait_queue_t;
+
+/* Explanation:
+ * The ready queues of one processor, one per priority: every process that
+ * can run there but is not running, in the order they will run, linked 
+ * through their PCBs' run_next and run_prev fields. 
+ *    head, tail -- The ends of each queue.
+ *    bitmap -- Bit p is set while the queue of priority p is not empty.
+ *    count -- The number of processes on all of them.
+ */
+typedef struct run_queue_t {
+	struct pcb_t * head[NUM_PRIORITIES];
+	struct pcb_t * tail[NUM_PRIORITIES];
+	uint32_t bitmap;
+	uint32_t count;
+} run_queue_t;
+
+/* Explanation:
+ * The real-time state of a process, set up by sched_set_periodic. All 
+ * times are in PIT ticks.
+ *    period -- The length of each period, or 0 for a normal process.
+ *    budget -- How long the process may run as real-time in each period.
+ *    budget_left -- What is left of the budget in the current period.
+ *    deadline -- The tick at which the current period ends.
+ *    pending -- Set while the process has work to do in the current period:
+ *               from when it wakes up (or starts) until it blocks again.
+ *    queued -- Set while it waits on the real-time ready queue.
+ *    periods -- The number of periods that have ended.
+ *    misses -- The number of periods that ended with work still pending.
+ *    util -- Its share of the processor, budget / period, in thousandths.
+ */
+typedef struct rt_task_t {
+	uint32_t period;
+	uint32_t budget;
+	uint32_t budget_left;
+	uint32_t deadline;
+	uint32_t pending;
+	uint32_t queued;
+	uint32_t periods;
+	uint32_t misses;
+	uint32_t util;
+} rt_task_t;
+
+/* Explanation:
+ * The real-time statistics of a process, as returned by get_rt_stats.
+ *    period_ms, budget_ms -- The parameters, rounded up to PIT ticks.
+ *    periods -- The number of periods that have ended.
+ *    deadline_misses -- The number of periods that ended with work pending.
+ */
+typedef struct rt_stats_t {
+	uint32_t period_ms;
+	uint32_t budget_ms;
+	uint32_t periods;
+	uint32_t deadline_misses;
+} rt_stats_t;
+
+/* Explanation:
+ * A time, as returned by clock_gettime.
+ *    sec -- Whole seconds.
+ *    nsec -- Nanoseconds, 0 to NS_PER_SEC - 1.
+ */
+typedef struct timespec_t {
+	uint32_t sec;
+	uint32_t nsec;
+} timespec_t;
+
 
 
 /* Initializes the PIT for usage. */
@@ -32,6 +173,63 @@ void pit_init(void);
 /* The handler for an PIT interrupt. */
 void pit_interruption(void); 
 
+/* The handler for a local APIC timer interrupt. */
+void apic_timer_interruption(void);
+
+/* Busy-waits for a number of PIT counts. */
+void pit_wait(uint32_t count);
+
+/* The handler for the reschedule interrupt other processors send. */
+void resched_interruption(void);
+
+/* Starts scheduling on a processor that has just come online. */
+void sched_start_cpu(void);
+
+/* The TSC calibration (see pit_calibrate_tsc). */
+extern uint64_t tsc_boot;
+extern uint32_t tsc_per_tick;
+extern uint32_t tsc_per_ms;
+extern uint32_t tsc_ns_mult;
+
+/* Returns the milliseconds since boot. */
+uint32_t sched_now_ms(void);
+
+/* Returns the nanoseconds since boot. */
+uint64_t sched_clock_ns(void);
+
+/* Brings the boot processor's timer forward for a kernel timer just added. */
+void sched_ktimer_added(void);
+
+/* The handler for the kernel's yield interrupt. */
+void yield_interruption(void);
+
+/* Blocks the current process on a wait queue until it is woken. */
+void sleep_on(wait_queue_t * queue);
+
+/* Wakes every process on a wait queue. */
+void wake_up(wait_queue_t * queue);
+
+/* Switches to a just woken foreground process, if there is one. */
+void sched_preempt(void);
+
+/* Puts a process that can run at the back of the ready queue. */
+void ready_enqueue(struct pcb_t * pcb);
+
+/* Changes the priority of a process. */
+int32_t sched_set_priority(struct pcb_t * pcb, uint32_t priority);
+
+/* Puts a process in the periodic real-time class, or takes it out. */
+int32_t sched_set_periodic(struct pcb_t * pcb, uint32_t period_ms, uint32_t budget_ms);
+
+/* Fills in the real-time statistics of a process. */
+void sched_get_rt_stats(struct pcb_t * pcb, rt_stats_t * stats);
+
+/* Prints the cost of the scheduling decisions. */
+void sched_print_stats(void);
+
+/* Measures the cost of a bare context switch, with and without a CR3 load. */
+void sched_bench(void);
+
 
 
 #endif /* SCHEDULER_H */
@@ -0,0 +1,298 @@
+/********************************************/
+/* slab.c - The kernel's object allocator.  */
+/********************************************/
+#include "slab.h"
+#include "frames.h"
+#include "lib.h"
+#include "debug.h"
+
+
+/* Every cache that has been set up, for slab_print_stats. */
+slab_cache_t * all_caches;
+
+/* The caches behind kmalloc, one per power of two size class. */
+slab_cache_t kmalloc_caches[KMALLOC_NUM_CACHES];
+
+/* The names of the kmalloc caches. */
+const int8_t * kmalloc_names[KMALLOC_NUM_CACHES] = {
+	"kmalloc-64", "kmalloc-128", "kmalloc-256", "kmalloc-512", "kmalloc-1024"
+};
+
+
+
+/*
+ * slab_init()
+ *
+ * Description:
+ * Sets up the kmalloc size classes. Must run after the frame allocator.
+ *
+ * Inputs: none
+ * Retvals: none
+ */
+void slab_init(void)
+{
+	/* Local variables. */
+	uint32_t i;
+
+	for( i = 0; i < KMALLOC_NUM_CACHES; i++ )
+	{
+		slab_cache_init(&kmalloc_caches[i], kmalloc_names[i], KMALLOC_MIN_SIZE << i);
+	}
+}
+
+/*
+ * slab_cache_init()
+ *
+ * Description:
+ * Sets up a cache of objects of the given size. The cache itself is
+ * provided by the caller (usually a static variable of the subsystem that
+ * owns the objects). No slabs are allocated until the first allocation.
+ *
+ * Inputs:
+ * cache: the cache to set up
+ * name: the name shown in the statistics
+ * object_size: the size of each object
+ *
+ * Retvals:
+ * -1: failure (the objects do not fit in a slab)
+ * 0: success
+ */
+int32_t slab_cache_init(slab_cache_t * cache, const int8_t * name, uint32_t object_size)
+{
+	/* Round up to whole cache lines, so every object starts on one. */
+	object_size = (object_size + CACHE_LINE_SIZE - 1) & ~(CACHE_LINE_SIZE - 1);
+	if( object_size == 0 || object_size > SLAB_SIZE - SLAB_HEADER_SIZE )
+	{
+		return -1;
+	}
+
+	memset(cache, 0, sizeof(slab_cache_t));
+	cache->name = name;
+	cache->object_size = object_size;
+	cache->objects_per_slab = (SLAB_SIZE - SLAB_HEADER_SIZE) / object_size;
+
+	cache->next = all_caches;
+	all_caches = cache;
+
+	return 0;
+}
+
+/*
+ * slab_grow()
+ *
+ * Description:
+ * Adds a slab to a cache and puts all of its objects on the free list.
+ *
+ * Inputs:
+ * cache: the cache to grow
+ *
+ * Retvals:
+ * -1: failure (out of memory)
+ * 0: success
+ */
+static int32_t slab_grow(slab_cache_t * cache)
+{
+	/* Local variables. */
+	slab_t * slab;
+	uint8_t * object;
+	uint32_t i;
+
+	slab = (slab_t *)frame_alloc(FRAME_KERNEL);
+	if( slab == NULL )
+	{
+		return -1;
+	}
+
+	slab->cache = cache;
+	slab->objects_in_use = 0;
+
+	/* Chain the objects together, last one first, through their first word. */
+	object = (uint8_t *)slab + SLAB_HEADER_SIZE + cache->objects_per_slab*cache->object_size;
+	for( i = 0; i < cache->objects_per_slab; i++ )
+	{
+		object -= cache->object_size;
+#ifdef DEBUG
+		memset(object, POISON_FREE, cache->object_size);
+#endif
+		*(void **)object = cache->free_list;
+		cache->free_list = object;
+	}
+
+	cache->num_slabs++;
+	return 0;
+}
+
+/*
+ * slab_alloc()
+ *
+ * Description:
+ * Allocates an object from a cache, growing it by a slab if it is empty.
+ * In debug builds the object is checked for writes made after it was
+ * freed, then filled with POISON_ALLOC so that reads of fields the caller
+ * forgot to set stand out.
+ *
+ * Inputs:
+ * cache: the cache to allocate from
+ *
+ * Retvals:
+ * NULL: failure (out of memory)
+ * the object otherwise
+ */
+void * slab_alloc(slab_cache_t * cache)
+{
+	/* Local variables. */
+	void * object;
+	uint32_t flags;
+#ifdef DEBUG
+	uint32_t i;
+#endif
+
+	cli_and_save(flags);
+
+	if( cache->free_list == NULL && -1 == slab_grow(cache) )
+	{
+		cache->failed_allocs++;
+		restore_flags(flags);
+		return NULL;
+	}
+
+	object = cache->free_list;
+	cache->free_list = *(void **)object;
+
+	((slab_t *)((uint32_t)object & ~(SLAB_SIZE - 1)))->objects_in_use++;
+	cache->objects_in_use++;
+	cache->total_allocs++;
+
+	restore_flags(flags);
+
+#ifdef DEBUG
+	for( i = sizeof(void *); i < cache->object_size; i++ )
+	{
+		if( ((uint8_t *)object)[i] != POISON_FREE )
+		{
+			printf("slab: %s object 0x%#x written after free\n", cache->name, (uint32_t)object);
+			break;
+		}
+	}
+	memset(object, POISON_ALLOC, cache->object_size);
+#endif
+
+	return object;
+}
+
+/*
+ * slab_free()
+ *
+ * Description:
+ * Returns an object to the cache it came from, which is found through the
+ * header of the slab holding it. In debug builds the object is poisoned
+ * with POISON_FREE. Slabs are kept once allocated, so a cache stays at its
+ * largest size.
+ *
+ * Inputs:
+ * object: the object to free (NULL is ignored)
+ *
+ * Retvals: none
+ */
+void slab_free(void * object)
+{
+	/* Local variables. */
+	slab_t * slab;
+	slab_cache_t * cache;
+	uint32_t flags;
+
+	if( object == NULL )
+	{
+		return;
+	}
+
+	slab = (slab_t *)((uint32_t)object & ~(SLAB_SIZE - 1));
+	cache = slab->cache;
+	ASSERT( ((uint32_t)object - (uint32_t)slab - SLAB_HEADER_SIZE) % cache->object_size == 0 );
+
+#ifdef DEBUG
+	memset(object, POISON_FREE, cache->object_size);
+#endif
+
+	cli_and_save(flags);
+
+	*(void **)object = cache->free_list;
+	cache->free_list = object;
+
+	slab->objects_in_use--;
+	cache->objects_in_use--;
+	cache->total_frees++;
+
+	restore_flags(flags);
+}
+
+/*
+ * kmalloc()
+ *
+ * Description:
+ * Allocates 'size' bytes from the smallest kmalloc size class that fits.
+ * The memory is cache line aligned.
+ *
+ * Inputs:
+ * size: the number of bytes wanted
+ *
+ * Retvals:
+ * NULL: failure (too big, or out of memory)
+ * the memory otherwise
+ */
+void * kmalloc(uint32_t size)
+{
+	/* Local variables. */
+	uint32_t i;
+
+	for( i = 0; i < KMALLOC_NUM_CACHES; i++ )
+	{
+		if( size <= (KMALLOC_MIN_SIZE << i) )
+		{
+			return slab_alloc(&kmalloc_caches[i]);
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * kfree()
+ *
+ * Description:
+ * Frees memory from kmalloc. Since every object knows its cache, this is
+ * the same as slab_free.
+ *
+ * Inputs:
+ * ptr: the memory to free (NULL is ignored)
+ *
+ * Retvals: none
+ */
+void kfree(void * ptr)
+{
+	slab_free(ptr);
+}
+
+/*
+ * slab_print_stats()
+ *
+ * Description:
+ * Prints the statistics of every cache. CTRL + M calls it (see
+ * process_keyboard_input).
+ *
+ * Inputs: none
+ * Retvals: none
+ */
+void slab_print_stats(void)
+{
+	/* Local variables. */
+	slab_cache_t * cache;
+
+	for( cache = all_caches; cache != NULL; cache = cache->next )
+	{
+		printf("%s: size %d, slabs %d, in use %d, allocs %d, frees %d, failed %d\n",
+		       cache->name, cache->object_size,
+		       cache->num_slabs, cache->objects_in_use, cache->total_allocs,
+		       cache->total_frees, cache->failed_allocs);
+	}
+}
@@ -0,0 +1,85 @@
+/********************************************/
+/* slab.h - The kernel's object allocator.  */
+/********************************************/
+#ifndef SLAB_H
+#define SLAB_H
+
+
+
+#include "types.h"
+
+
+
+/* Constants. */
+#define CACHE_LINE_SIZE      64
+#define SLAB_SIZE            _4KB
+#define SLAB_HEADER_SIZE     CACHE_LINE_SIZE   // objects start on the next line
+#define KMALLOC_MIN_SIZE     64
+#define KMALLOC_MAX_SIZE     1024
+#define KMALLOC_NUM_CACHES   5                 // 64, 128, 256, 512 and 1024 bytes
+
+/* Poison patterns for debug builds. */
+#define POISON_ALLOC         0xA5              // fresh from slab_alloc
+#define POISON_FREE          0x6B              // sitting on a free list
+
+
+
+/* Explanation:
+ * A cache of equally sized objects. The objects live in slabs, each one a
+ * 4kB frame whose first cache line is a slab_t header pointing back at the
+ * cache, so an object's cache can be found from its address alone. Free
+ * objects from every slab are chained into one free list through their
+ * first word, which makes allocating and freeing O(1).
+ *    name -- Shown in the statistics.
+ *    object_size -- The size of each object, rounded up to a cache line.
+ *    objects_per_slab -- How many objects fit in one slab.
+ *    free_list -- The first free object, or NULL.
+ *    num_slabs, objects_in_use -- The size of the cache right now.
+ *    total_allocs, total_frees, failed_allocs -- Counts since boot.
+ *    next -- Links every cache together for slab_print_stats.
+ */
+typedef struct slab_cache_t {
+	const int8_t * name;
+	uint32_t object_size;
+	uint32_t objects_per_slab;
+	void * free_list;
+	uint32_t num_slabs;
+	uint32_t objects_in_use;
+	uint32_t total_allocs;
+	uint32_t total_frees;
+	uint32_t failed_allocs;
+	struct slab_cache_t * next;
+} slab_cache_t;
+
+/* The header at the start of every slab. */
+typedef struct slab_t {
+	slab_cache_t * cache;
+	uint32_t objects_in_use;
+} slab_t;
+
+
+
+/* Sets up the kmalloc size classes. */
+void slab_init(void);
+
+/* Sets up a cache of objects of the given size. */
+int32_t slab_cache_init(slab_cache_t * cache, const int8_t * name, uint32_t object_size);
+
+/* Allocates an object from a cache. */
+void * slab_alloc(slab_cache_t * cache);
+
+/* Returns an object to the cache it came from. */
+void slab_free(void * object);
+
+/* Allocates 'size' bytes from the smallest size class that fits. */
+void * kmalloc(uint32_t size);
+
+/* Frees memory from kmalloc (or any slab_alloc). */
+void kfree(void * ptr);
+
+/* Prints the statistics of every cache. */
+void slab_print_stats(void);
+
+
+
+#endif /* SLAB_H */
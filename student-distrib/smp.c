@@ -0,0 +1,230 @@
+/*************************************************/
+/* smp.c - Multiprocessor support.               */
+/*************************************************/
+#include "smp.h"
+#include "lib.h"
+#include "acpi.h"
+#include "apic.h"
+#include "frames.h"
+#include "syscalls.h"
+
+
+
+/* Every processor, and how many are online. */
+cpu_t cpus[MAX_CPUS];
+uint32_t num_cpus = 1;
+
+/* The TSSs of the processors other than the boot processor. */
+tss_t cpu_tss[MAX_CPUS - 1];
+
+/*
+ * The kernel lock. The kernel was written for one processor, and keeps its
+ * data consistent by masking interrupts; holding this lock whenever a
+ * processor runs kernel code (see kernel_enter) keeps that working with
+ * several. Processes still run in parallel in user space.
+ */
+spinlock_t kernel_lock;
+
+/* The real mode start up code, and the GDT descriptor inside it (smp_boot.S). */
+extern uint8_t ap_trampoline[];
+extern uint8_t ap_trampoline_end[];
+extern uint8_t ap_gdt_desc[];
+
+/* The stack, and cpus[] entry, of the processor being started. */
+extern uint32_t ap_boot_stack;
+uint32_t ap_boot_cpu;
+
+
+
+/*
+ * kernel_enter()
+ *
+ * Description:
+ * Takes the kernel lock, or counts one more hold on it if this processor
+ * already has it. Called by the interrupt and system call wrappers before
+ * any kernel code runs, with interrupts masked.
+ *
+ * Inputs: none
+ * Retvals: none
+ */
+void kernel_enter(void)
+{
+	/* Local variables. */
+	cpu_t * cpu = this_cpu();
+
+	if( cpu->lock_depth++ == 0 )
+	{
+		spin_lock(&kernel_lock);
+	}
+}
+
+/*
+ * kernel_exit()
+ *
+ * Description:
+ * Counts one less hold on the kernel lock, letting go of it after the
+ * last. Called by the wrappers just before they return, with interrupts
+ * masked, and by to_the_user_space.
+ *
+ * Inputs: none
+ * Retvals: none
+ */
+void kernel_exit(void)
+{
+	/* Local variables. */
+	cpu_t * cpu = this_cpu();
+
+	if( --cpu->lock_depth == 0 )
+	{
+		spin_unlock(&kernel_lock);
+	}
+}
+
+/*
+ * setup_cpu_tss()
+ *
+ * Description:
+ * Sets up the TSS of a processor other than the boot processor and its
+ * descriptor in the GDT.
+ *
+ * Inputs: index - the processor's index in cpus[]
+ * Retvals: none
+ */
+static void setup_cpu_tss(uint32_t index)
+{
+	/* Local variables. */
+	seg_desc_t * desc = &cpu_tss_desc_ptr[index - 1];
+	tss_t * cpu_tss_entry = &cpu_tss[index - 1];
+
+	memset(cpu_tss_entry, 0, sizeof(tss_t));
+	cpu_tss_entry->ldt_segment_selector = KERNEL_LDT;
+	cpu_tss_entry->ss0 = KERNEL_DS;
+
+	desc->granularity    = 0;
+	desc->opsize         = 0;
+	desc->reserved       = 0;
+	desc->avail          = 0;
+	desc->seg_lim_19_16  = TSS_SIZE & 0x000F0000;
+	desc->present        = 1;
+	desc->dpl            = 0x0;
+	desc->sys            = 0;
+	desc->type           = 0x9;
+	desc->seg_lim_15_00  = TSS_SIZE & 0x0000FFFF;
+	SET_TSS_PARAMS((*desc), cpu_tss_entry, tss_size);
+
+	cpus[index].tss = cpu_tss_entry;
+}
+
+/*
+ * smp_init()
+ *
+ * Description:
+ * Finds the other processors in the MADT and starts them one at a time,
+ * waiting for each to come online. Each gets its own TSS, and a page for
+ * the stack of its idle task, which it starts out on. A processor that does
+ * not come online in time is parked with an INIT, and no more are started:
+ * it might still be on its way in, using ap_boot_cpu, ap_boot_stack and
+ * its slot in cpus[], so none of them can be freed or used again. Must run
+ * on the boot processor after apic_init and pit_init, holding the kernel
+ * lock, so the started processors wait for it before they schedule 
+ * anything.
+ *
+ * Inputs: none
+ * Retvals: none
+ */
+void smp_init(void)
+{
+	/* Local variables. */
+	acpi_info_t * info;
+	uint32_t i;
+	uint32_t index;
+	uint32_t wait;
+	uint32_t stack;
+
+	cpus[0].index = 0;
+	cpus[0].apic_id = apic_id();
+	cpus[0].tss = &tss;
+	cpus[0].online = 1;
+
+	info = acpi_get_info();
+	if( info->num_cpus < 2 || apic_timer_get_mode() == APIC_TIMER_NONE )
+	{
+		return;
+	}
+
+	/* The start up code runs in real mode, so it has to live below 1MB. */
+	memcpy((void *)TRAMPOLINE_ADDR, ap_trampoline, ap_trampoline_end - ap_trampoline);
+	memcpy((void *)(TRAMPOLINE_ADDR + (ap_gdt_desc - ap_trampoline)), &gdt_desc_ptr, 6);
+
+	index = 1;
+	for( i = 0; i < info->num_cpus && index < MAX_CPUS; i++ )
+	{
+		if( info->cpu_apic_ids[i] == cpus[0].apic_id )
+		{
+			continue;
+		}
+
+		stack = frame_alloc(FRAME_KERNEL);
+		if( stack == 0 )
+		{
+			break;
+		}
+
+		setup_cpu_tss(index);
+		cpus[index].index = index;
+		cpus[index].apic_id = info->cpu_apic_ids[i];
+		cpus[index].idle_stack = (uint8_t *)stack;
+
+		ap_boot_cpu = index;
+		ap_boot_stack = stack + IDLE_STACK_SIZE - 16;
+		apic_start_cpu(cpus[index].apic_id, TRAMPOLINE_ADDR >> 12);
+
+		for( wait = 0; wait < AP_START_TIMEOUT && !cpus[index].online; wait++ )
+		{
+			pit_wait(DIVISOR_100HZ);
+		}
+
+		if( !cpus[index].online )
+		{
+			printf("smp: processor %d did not start\n", cpus[index].apic_id);
+			apic_stop_cpu(cpus[index].apic_id);
+			cpus[index].online = 0;
+			break;
+		}
+
+		index++;
+	}
+
+	num_cpus = index;
+	printf("smp: %d processors online\n", num_cpus);
+}
+
+/*
+ * ap_main()
+ *
+ * Description:
+ * Where a started processor continues from smp_boot.S, on its idle stack
+ * with paging on. It loads its own TSS, turns on its local APIC and timer
+ * and its SYSENTER entry, says it is online, and becomes the idle task of its own scheduler as
+ * soon as it gets the kernel lock.
+ *
+ * Inputs: none
+ * Retvals: never returns
+ */
+void ap_main(void)
+{
+	/* Local variables. */
+	cpu_t * cpu = &cpus[ap_boot_cpu];
+
+	lldt(KERNEL_LDT);
+	ltr(CPU_TSS_BASE + (cpu->index - 1) * 8);
+
+	apic_init();
+	apic_timer_enable();
+	sysenter_init();
+
+	cpu->online = 1;
+
+	kernel_enter();
+	sched_start_cpu();
+}
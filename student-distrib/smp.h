@@ -0,0 +1,146 @@
+/*************************************************/
+/* smp.h - Multiprocessor support.               */
+/*************************************************/
+#ifndef SMP_H
+#define SMP_H
+
+
+
+#include "x86_desc.h"
+
+/* Where the application processors' real mode start up code is copied. */
+#define TRAMPOLINE_ADDR       0x8000
+
+#ifndef ASM
+
+#include "types.h"
+#include "scheduler.h"
+
+
+
+/* How long to wait for a started processor to come online, in 10ms steps. */
+#define AP_START_TIMEOUT      10
+
+
+
+/* A lock that spins until it is free. */
+typedef struct spinlock_t {
+	volatile uint32_t locked;
+} spinlock_t;
+
+/* Explanation:
+ * The state of each processor. Only the processor itself touches its
+ * entry, except for the run queue, which other processors steal from
+ * while they hold the kernel lock.
+ *    index -- Its index in cpus[]. The boot processor is 0.
+ *    apic_id -- Its local APIC ID.
+ *    online -- Set once it has started and can run processes.
+ *    current -- The process it runs, or NULL while it idles.
+ *    kernel_stack_bottom -- The top of the kernel stack of that process.
+ *    tss -- Its TSS, whose esp0 is that same stack.
+ *    lock_depth -- How many times it has entered the kernel lock.
+ *    rq -- The processes that wait to run on it.
+ *    idle_stack -- The stack its idle task runs on.
+ *    idle_ksp -- The idle task's stack pointer while it is switched out.
+ *    idle_lock_depth -- The idle task's lock_depth while it is switched out.
+ *    idle_running -- Set while its idle task runs.
+ *    need_resched -- Set when a process woken on it should preempt
+ *                    'current' (see sched_preempt).
+ *    charged_ticks -- The tick up to which 'current' has been charged.
+ *    timer_target -- The TSC value its pending timer interrupt is for, or
+ *                    TIMER_STOPPED.
+ *    switch_start -- The TSC value its last context switch started at.
+ */
+typedef struct cpu_t {
+	uint32_t index;
+	uint32_t apic_id;
+	volatile uint32_t online;
+	struct pcb_t * current;
+	uint32_t kernel_stack_bottom;
+	tss_t * tss;
+	uint32_t lock_depth;
+	run_queue_t rq;
+	uint8_t * idle_stack;
+	uint32_t idle_ksp;
+	uint32_t idle_lock_depth;
+	uint32_t idle_running;
+	uint32_t need_resched;
+	uint32_t charged_ticks;
+	uint64_t timer_target;
+	uint64_t switch_start;
+} cpu_t;
+
+
+
+/* Every processor, and how many are online. */
+extern cpu_t cpus[MAX_CPUS];
+extern uint32_t num_cpus;
+
+/*
+ * this_cpu()
+ *
+ * Description:
+ * Returns the processor running this. Each processor has its own TSS, so
+ * the task register tells them apart without touching memory.
+ *
+ * Inputs: none
+ * Retvals: its cpu_t
+ */
+static inline cpu_t * this_cpu(void)
+{
+	uint32_t selector;
+
+	asm volatile("str %0" : "=r"(selector));
+	selector &= 0xFFFF;
+	if( selector < CPU_TSS_BASE )
+	{
+		return &cpus[0];
+	}
+
+	return &cpus[(selector - CPU_TSS_BASE) / 8 + 1];
+}
+
+/* Spins until the lock is free, then takes it. */
+static inline void spin_lock(spinlock_t * lock)
+{
+	uint32_t old;
+
+	do {
+		while( lock->locked )
+		{
+			asm volatile("pause");
+		}
+		old = 1;
+		asm volatile("xchgl %0, %1"
+				: "+r"(old), "+m"(lock->locked)
+				:
+				: "memory");
+	} while( old != 0 );
+}
+
+/* Frees the lock. */
+static inline void spin_unlock(spinlock_t * lock)
+{
+	asm volatile("" ::: "memory");
+	lock->locked = 0;
+}
+
+
+
+/* Finds the other processors and starts them. */
+void smp_init(void);
+
+/* Where a started processor continues once it runs in protected mode. */
+void ap_main(void);
+
+/* Takes the kernel lock, on every entry into the kernel. */
+void kernel_enter(void);
+
+/* Lets go of the kernel lock, on every return from the kernel. */
+void kernel_exit(void);
+
+#endif /* ASM */
+
+
+
+#endif /* SMP_H */
@@ -7,56 +7,246 @@
 #include "keyboard.h"
 #include "rtc.h"
 #include "files.h"
+#include "process.h"
+#include "slab.h"
+#include "scheduler.h"
+#include "smp.h"
+#include "apic.h"
 
 
 /*** GLOBAL VARIABLES ***/
-/* The bitmask representing running processes. */
-uint8_t running_processes = 0x80;
+/* The cache the file descriptors are allocated from. */
+slab_cache_t fd_cache;
 
-/* The address of the current process's kernel stack bottom. */
-uint32_t kernel_stack_bottom;
-
-/* Address of the page directory for the current process. */
-uint32_t page_dir_addr;
-
-/* Number of the current running process, defined from 0-7 */
-uint8_t current_process_number = 0;
+/* Set once the processors take system calls through SYSENTER (see sysenter_init). */
+uint32_t sysenter_active;
 
 
 
 /*
  * Initialize the file operations tables -- we will make the
- * file descriptors' jumptable pointers point to these tables when
- * we open a file.
+ * file descriptors' fops pointers point to these tables when
+ * we open a file. Missing operations are left NULL.
  */
  
 /* stdin file operations table */
-uint32_t stdin_fops_table[4] = { (uint32_t)(no_function),
-								 (uint32_t)(terminal_read),
-								 (uint32_t)(no_function),
-								 (uint32_t)(no_function) };
+const fops_t stdin_fops = { NULL, terminal_read, NULL, NULL };
+
 /* stdout file operations table */
-uint32_t stdout_fops_table[4] = { (uint32_t)(no_function),
-								  (uint32_t)(no_function),
-								  (uint32_t)(terminal_write),
-								  (uint32_t)(no_function) };
+const fops_t stdout_fops = { NULL, NULL, terminal_write, NULL };
+
 /* rtc file operations table */
-uint32_t rtc_fops_table[4] = { (uint32_t)(rtc_open),
-							   (uint32_t)(rtc_read),
-							   (uint32_t)(rtc_write),
-							   (uint32_t)(rtc_close) };
+const fops_t rtc_fops = { rtc_open, rtc_read, rtc_write, rtc_close };
+
 /* file file operations table */
-uint32_t file_fops_table[4] = { (uint32_t)(file_open),
-							    (uint32_t)(file_read),
-							    (uint32_t)(file_write),
-							    (uint32_t)(file_close) };
+const fops_t file_fops = { file_open, file_read, file_write, file_close };
+
 /* directory file operations table */
-uint32_t dir_fops_table[4] = { (uint32_t)(dir_open),
-							   (uint32_t)(dir_read),
-							   (uint32_t)(dir_write),
-							   (uint32_t)(dir_close) };
-							   
+const fops_t dir_fops = { dir_open, dir_read, dir_write, dir_close };
 			   
+/*
+ * read_program_header()
+ *
+ * Looks up an executable and reads its header -- the ELF magic number and 
+ * the entry point -- with a single read. The rest of the program is paged
+ * in from the file system image as it runs.
+ *
+ * Inputs: fname - the name of the program
+ *         image - set to the program's inode
+ *         entry_point - set to the program's entry point
+ * Retvals: 0 on success, -1 if the file is missing or not an executable
+ * 
+ */
+static int32_t read_program_header(const uint8_t * fname, inode_t ** image, 
+                                   uint32_t * entry_point)
+{
+	/* Local variables. */
+	dentry_t dentry;
+	uint8_t header[PROGRAM_HEADER_SIZE];
+	uint8_t magic_nums[4] = {0x7f, 0x45, 0x4c, 0x46};
+	uint32_t i;
+	
+	if( -1 == read_dentry_by_name(fname, &dentry) )
+	{
+		return -1;
+	}
+	
+	*image = fs_get_inode(dentry.inode);
+	if( *image == NULL || 
+	    PROGRAM_HEADER_SIZE != read_data(dentry.inode, 0, header, PROGRAM_HEADER_SIZE) )
+	{
+		return -1;
+	}
+	
+	/* Ensure an executable program image. */
+	if( 0 != strncmp((const int8_t*)header, (const int8_t*)magic_nums, 4) )
+	{
+		return -1;
+	}
+	
+	/* Save the entry point. */
+	*entry_point = 0;
+	for( i = 0; i < 4; i++ )
+	{
+		*entry_point |= (header[ENTRY_POINT_OFFSET + i] << 8*i);
+	}
+	
+	return 0;
+}
+
+/*
+ * alloc_file_descriptor()
+ *
+ * Allocates a file descriptor from the file descriptor cache, with every
+ * field cleared.
+ *
+ * Inputs: none
+ * Retvals: the descriptor, or NULL if we are out of memory
+ * 
+ */
+static file_descriptor_t * alloc_file_descriptor(void)
+{
+	/* Local variables. */
+	file_descriptor_t * file = (file_descriptor_t *)slab_alloc(&fd_cache);
+	
+	if( file != NULL )
+	{
+		memset(file, 0, sizeof(file_descriptor_t));
+	}
+	
+	return file;
+}
+
+/*
+ * mmap_slot_used()
+ *
+ * Tells whether a slot of a process's mmap window is mapped.
+ *
+ * Inputs: pcb - the process
+ *         slot - the slot
+ * Retvals: non-zero if it is, 0 otherwise
+ * 
+ */
+static uint32_t mmap_slot_used(pcb_t * pcb, uint32_t slot)
+{
+	return pcb->mmap_used[slot / 32] & (1 << (slot % 32));
+}
+
+/*
+ * mmap_find_slots()
+ *
+ * Finds the first run of 'pages' free slots in a process's mmap window.
+ *
+ * Inputs: pcb - the process
+ *         pages - how many slots are needed
+ * Retvals:
+ * -1: no run is long enough
+ * the first slot of the run otherwise
+ * 
+ */
+static int32_t mmap_find_slots(pcb_t * pcb, uint32_t pages)
+{
+	/* Local variables. */
+	uint32_t start;
+	uint32_t length = 0;
+	uint32_t slot;
+	
+	for( slot = 0, start = 0; slot < VDSO_PAGE && length < pages; slot++ )
+	{
+		if( mmap_slot_used(pcb, slot) )
+		{
+			start = slot + 1;
+			length = 0;
+		}
+		else
+		{
+			length++;
+		}
+	}
+	
+	return ( length >= pages ) ? (int32_t)start : -1;
+}
+
+/*
+ * unmap_file()
+ *
+ * Removes a file's pages from its process's mmap window, if it is mapped,
+ * and frees their slots for later mappings.
+ *
+ * Inputs: pcb - the process
+ *         file - the open file
+ * Retvals: none
+ * 
+ */
+static void unmap_file(pcb_t * pcb, file_descriptor_t * file)
+{
+	/* Local variables. */
+	uint32_t slot;
+	
+	for( slot = file->map_start; slot < file->map_start + file->map_pages; slot++ )
+	{
+		unmap_mmap_page( pcb, slot );
+		pcb->mmap_used[slot / 32] &= ~(1 << (slot % 32));
+	}
+	
+	file->map_pages = 0;
+}
+
+/*
+ * close_all_files()
+ *
+ * Closes every file a process still has open, stdin and stdout included,
+ * and gives the descriptors back to their cache.
+ *
+ * Inputs: pcb - the process
+ * Retvals: none
+ * 
+ */
+static void close_all_files(pcb_t * pcb)
+{
+	/* Local variables. */
+	uint32_t i;
+	
+	for( i = 0; i < 8; i++ )
+	{
+		if( pcb->fds[i] == NULL )
+		{
+			continue;
+		}
+		
+		if( pcb->fds[i]->fops->close != NULL )
+		{
+			pcb->fds[i]->fops->close(pcb->fds[i]);
+		}
+		unmap_file( pcb, pcb->fds[i] );
+		slab_free(pcb->fds[i]);
+		pcb->fds[i] = NULL;
+	}
+}
+
+/*
+ * cancel_alarm()
+ *
+ * Stops a process's alarm, if it has one, and frees its timer. Processes
+ * blocked in pause for it are not woken.
+ *
+ * Inputs: pcb - the process
+ * Retvals: none
+ * 
+ */
+static void cancel_alarm(pcb_t * pcb)
+{
+	if( pcb->alarm == NULL )
+	{
+		return;
+	}
+	
+	ktimer_cancel( pcb->alarm );
+	ktimer_free( pcb->alarm );
+	pcb->alarm = NULL;
+	pcb->alarm_count = 0;
+}
+
 /*
  * halt()
  *
@@ -72,14 +262,20 @@ int32_t halt(uint8_t status)
 	/* Local variables */
 	int i;
 	
-	/* Extract the PCB from the KBP */
-	pcb_t * process_control_block = (pcb_t *)(kernel_stack_bottom & ALIGN_8KB);
+	/* Get the PCB of the running process. */
+	pcb_t * process_control_block = get_current_pcb();
 	
+	/* 
+	 * The alarm stops with the process, or with the shell restarted in its
+	 * place, and its real-time share is given back.
+	 */
+	cancel_alarm( process_control_block );
+	sched_set_periodic( process_control_block, 0, 0 );
 	
 	/* Prevent the user from closing the final shell
 	 * NOTE -- In order to do this, we just restart the shell
 	 */
-	if( process_control_block->parent_process_number == 0 )
+	if( process_control_block->parent_process_number == PID_NONE )
 	{
 		printf("Silly rabbit, trix are for kids.\n");
 		
@@ -101,40 +297,30 @@ int32_t halt(uint8_t status)
 		to_the_user_space(entry_point);
 	}
 	
-	/* 
-	 * Mark the current process as 0, aka this process is done and its slot
-	 * is now available for new processes.
-	 */
-	uint8_t bitmask = 0x7F;
-	for( i = 0; i < process_control_block->process_number; i++ )
-	{
-		bitmask = (bitmask >> 1) + 0x80;
-	}
-	running_processes &= bitmask;
-	
-	/* Set the current process number back to the parent */
-	current_process_number = process_control_block->parent_process_number;
-	
 	/* Reset the parent to have no children */
-	pcb_t * parent_pcb = (pcb_t *)( _8MB - (_8KB)*(process_control_block->parent_process_number + 1) );
+	pcb_t * parent_pcb = process_lookup( process_control_block->parent_process_number );
 	parent_pcb->has_child = 0;
 	
-	/* Load the page directory of the parent. */
-	page_dir_addr = (uint32_t)(&page_directories[process_control_block->parent_process_number]);
-	asm (
-	"movl page_dir_addr, %%eax        ;"
-	"andl $0xFFFFFFE7, %%eax          ;"
-	"movl %%eax, %%cr3                ;"
-	"movl %%cr4, %%eax                ;"
-	"orl $0x00000090, %%eax           ;"
-	"movl %%eax, %%cr4                ;"
-	"movl %%cr0, %%eax                ;"
-	"orl $0x80000000, %%eax 	      ;"
-	"movl %%eax, %%cr0                 "
-	: : : "eax", "cc" );
+	/* Load the page directory of the parent, then give the child's memory back. */
+	load_page_directory( parent_pcb->page_directory );
+	set_current_pcb( parent_pcb );
+	parent_pcb->cpu = this_cpu()->index;
+	release_task( process_control_block );
+	close_all_files( process_control_block );
 	
 	/* Set the kernel_stack_bottom and the TSS to point back at the parent's kernel stack. */
-	kernel_stack_bottom = tss.esp0 = _8MB - (_8KB)*process_control_block->parent_process_number - 4;
+	set_kernel_stack_bottom( KERNEL_STACK_BOTTOM( parent_pcb ) );
+	
+	/* Keep the parent's stack pointers, since the PCB is about to be freed. */
+	uint32_t parent_ksp = process_control_block->parent_ksp;
+	uint32_t parent_kbp = process_control_block->parent_kbp;
+	
+	/* 
+	 * Remove this process from the process table. Its kernel stack stays 
+	 * in use until we switch stacks below, so freeing it is left to the 
+	 * next process_create or process_destroy.
+	 */
+	process_destroy( process_control_block );
 	
 	/* 
 	 * Switch the kernel stack back to the parent's kernel stack by
@@ -149,10 +335,10 @@ int32_t halt(uint8_t status)
 	/* Put the "parent_ksp" into the %ESP. */
 	asm volatile("movl %0, %%esp	;"
 				 "pushl %1			;"
-				 ::"g"(process_control_block->parent_ksp),"g"(the_status));
+				 ::"g"(parent_ksp),"g"(the_status));
 				 
 	/* Put the "parent_kbp" into the %EBP. */
-	asm volatile("movl %0, %%ebp"::"g"(process_control_block->parent_kbp));
+	asm volatile("movl %0, %%ebp"::"g"(parent_kbp));
 	
 	asm volatile("popl %eax");
 	
@@ -188,11 +374,9 @@ int32_t execute(const uint8_t* command)
 {
 	/* Local variables. */
 	uint8_t fname[32];
-	uint8_t buf[4];
 	uint32_t i;
 	uint32_t entry_point;
-	uint8_t magic_nums[4] = {0x7f, 0x45, 0x4c, 0x46};
-	uint8_t open_process;
+	inode_t * image;
 	uint32_t first_space_reached;
 	uint32_t length_of_fname;
 	uint8_t localargbuf[TERMINAL_BUFFER_MAX_SIZE];
@@ -239,62 +423,33 @@ int32_t execute(const uint8_t* command)
 		fname[i] = '\0';
 	}
 	
-	/* 
-	 * Read the identifying 4 bytes from the file into buf which
-	 * identify an executable program image or not. 
-	 */
-	if( -1 == fs_read((const int8_t *)fname, 0, buf, 4) )
-	{
-		return -1;
-	}
-	
-	/* Ensure an executable program image. */
-	if( 0 != strncmp((const int8_t*)buf, (const int8_t*)magic_nums, 4) )
+	/* Read the program's header, making sure it is an executable. */
+	if( -1 == read_program_header(fname, &image, &entry_point) )
 	{
 		return -1;
 	}
 	
-	/* Look for an open slot for the process. */
-	uint8_t bitmask = 0x80;
-	for( i = 0; i < 8; i++ ) 
-	{
-		if( !(running_processes & bitmask) ) 
-		{
-			open_process = i;
-			running_processes |= bitmask;
-			current_process_number = open_process;
-			break;
-		}
-		bitmask >>= 1;
-		if( bitmask == 0 )
-		{
-			return -1;
-		}
-	}
-	
-	/* Get the entry point to the program. */
-	if( -1 == fs_read((const int8_t *)fname, ENTRY_POINT_OFFSET, buf, 4) )
+	/* Allocate a PCB, kernel stack and PID for the process. */
+	pcb_t * parent_pcb = get_current_pcb();
+	pcb_t * process_control_block = process_create();
+	if( process_control_block == NULL )
 	{
 		return -1;
 	}
 	
-	/* Save the entry point. */
-	for( i = 0; i < 4; i++ )
-	{
-		entry_point |= (buf[i] << 8*i);
-	}
-	
 	/* Set up the new page directory for the new task. */
-	if( -1 == setup_new_task( open_process ) )
+	if( -1 == setup_new_task( process_control_block ) )
 	{
+		process_destroy( process_control_block );
 		return -1;
 	}
+	set_current_pcb( process_control_block );
 	
-	/* Load the program to the appropriate starting address. */
-	fs_load((const int8_t *)fname, PROGRAM_LOAD_ADDR);
-	
-	/* Extract the PCB from the KBP */
-	pcb_t * process_control_block = (pcb_t *)( _8MB - (_8KB)*(open_process + 1) );
+	/* 
+	 * Record the program file instead of loading it -- its pages are copied 
+	 * to PROGRAM_LOAD_ADDR by the page fault handler when first touched.
+	 */
+	process_control_block->program_image = image;
 	
 	/* Store the %ESP as "parent_ksp" in the PCB. */
 	uint32_t esp;
@@ -306,15 +461,15 @@ int32_t execute(const uint8_t* command)
 	asm volatile("movl %%ebp, %0":"=g"(ebp));
 	process_control_block->parent_kbp = ebp;
 	
-	if( running_processes == 0xC0 )
+	if( parent_pcb == NULL )
 	{
 		/* 
 		 * If this process was the first process called (aka, it was called from 
-		 * "no processes running" process), make the parent process number 0. 
+		 * "no processes running" process), make the parent PID_NONE. 
 		 * -- NOTE: we must do it like this because the "no processes running" 
 		 * process does not have a PCB.
 		 */
-		process_control_block->parent_process_number = 0;
+		process_control_block->parent_process_number = PID_NONE;
 		
 		/* If this is the first process, initialize it to tty #1. */
 		process_control_block->tty_number = 1;
@@ -322,32 +477,38 @@ int32_t execute(const uint8_t* command)
 	else
 	{
 		/* 
-		 * Set the parent_process_number of the new process to be the process 
-		 * number of the current process that called it (find this in the PCB).
+		 * Set the parent_process_number of the new process to be the PID
+		 * of the current process that called it.
 		 */
-		process_control_block->parent_process_number = ( (pcb_t *)(esp & ALIGN_8KB) )->process_number;
+		process_control_block->parent_process_number = parent_pcb->process_number;
 		
 		/* Indicate that the parent process has a child */
-		( (pcb_t *)(esp & ALIGN_8KB) )->has_child = 1;
+		parent_pcb->has_child = 1;
 		
 		/* Set the tty number of this process to be the same as the parent */
-		process_control_block->tty_number = ( (pcb_t *)(esp & ALIGN_8KB) )->tty_number;
+		process_control_block->tty_number = parent_pcb->tty_number;
+		
+		/* The child runs at its parent's priority. */
+		process_control_block->priority = parent_pcb->priority;
 	}
-	process_control_block->process_number = open_process;
+	
+	/* Its PID and terminal are known: fill in its data page. */
+	vdso_fill( process_control_block );
 	
 	/* Initialize fields in the PCB for each file descriptor. */
 	for( i = 0; i < 8; i++ )
 	{
-		process_control_block->fds[i].inode = 0;
-		process_control_block->fds[i].fileposition = 0;
-		process_control_block->fds[i].flags = NOT_IN_USE;
+		process_control_block->fds[i] = NULL;
 	}
 	
+	/* Nothing is mapped in the new process's mmap window yet. */
+	memset( process_control_block->mmap_used, 0, sizeof(process_control_block->mmap_used) );
+	
 	/* Store the args passed to this function into the PCB. */
 	strcpy((int8_t*)process_control_block->argbuf, (const int8_t*)localargbuf);
 	
 	/* Set the kernel_stack_bottom and tss.esp0 field to be the bottom of the new kernel stack. */
-	kernel_stack_bottom = tss.esp0 = _8MB - (_8KB)*open_process - 4;
+	set_kernel_stack_bottom( KERNEL_STACK_BOTTOM( process_control_block ) );
 	
 	/* Call open for stdin and stdout. */
 	open( (uint8_t *) "stdin"  );
@@ -385,43 +546,43 @@ void execute_test(void)
 int32_t bootup(void)
 {
 	/* Local variables. */
-	uint8_t buf[4];
 	uint32_t i;
 	uint32_t j;
 	uint32_t entry_point;
+	inode_t * image;
 	uint32_t esp;
 	uint32_t ebp;
+	uint32_t kernel_stack_bottom;
 	pcb_t * process_control_block;
 	
 	/* Initializations. */
 	entry_point = 0;
 	
-	/* Get the entry point to shell. */
-	if( -1 == fs_read((const int8_t *)("shell"), ENTRY_POINT_OFFSET, buf, 4) )
+	/* Read the shell's header, which all three shells share. */
+	if( -1 == read_program_header((const uint8_t *)("shell"), &image, &entry_point) )
 	{
 		return -1;
 	}
 	
-	/* Save the entry point. */
-	for( i = 0; i < 4; i++ )
-	{
-		entry_point |= (buf[i] << 8*i);
-	}
-	
 	/* Setup each shell. */
-	for( i = 3; i > 0; i-- )
+	for( i = NUM_INITIAL_SHELLS; i > 0; i-- )
 	{
-		/* Set up the new page directory for the new shell. */
-		if( -1 == setup_new_task(i) )
+		/* Allocate a PCB, kernel stack and PID for the shell. */
+		process_control_block = process_create();
+		if( process_control_block == NULL )
 		{
 			return -1;
 		}
 		
-		/* Load the program to the appropriate starting address. */
-		fs_load((const int8_t *)("shell"), PROGRAM_LOAD_ADDR);
+		/* Set up the new page directory for the new shell. */
+		if( -1 == setup_new_task( process_control_block ) )
+		{
+			return -1;
+		}
+		set_current_pcb( process_control_block );
 		
-		/* Get a pointer to the PCB. */
-		process_control_block = (pcb_t *)( _8MB - (_8KB)*(i + 1) );
+		/* The shell is paged in from the file system as it runs. */
+		process_control_block->program_image = image;
 	
 		/* Store the %ESP as "parent_ksp" in the PCB. */
 		asm volatile("movl %%esp, %0":"=g"(esp));
@@ -431,35 +592,43 @@ int32_t bootup(void)
 		asm volatile("movl %%ebp, %0":"=g"(ebp));
 		process_control_block->parent_kbp = ebp;
 		
-		/* Set the parent process number to be 0. */
-		process_control_block->parent_process_number = 0;
-		
-		/* Set the process number. */
-		process_control_block->process_number = i;
+		/* The shells have no parent. */
+		process_control_block->parent_process_number = PID_NONE;
 		
 		/* Initialize fields in the PCB for each file descriptor. */
 		for( j = 0; j < 8; j++ )
 		{
-			process_control_block->fds[j].inode = 0;
-			process_control_block->fds[j].fileposition = 0;
-			process_control_block->fds[j].flags = NOT_IN_USE;
+			process_control_block->fds[j] = NULL;
 		}
 		
-		/* The shells initially have no children. */
+		/* The shells initially have no children or mappings. */
 		process_control_block->has_child = 0;
+		memset( process_control_block->mmap_used, 0, sizeof(process_control_block->mmap_used) );
 		
-		/* Set the shell's terminal number. */
+		/* Set the shell's terminal number, and fill in its data page. */
 		process_control_block->tty_number = i-1;
+		vdso_fill( process_control_block );
 		
 		/* 
 		 * Set the kernel_stack_bottom and tss.esp0 field to be the bottom 
 		 * of the new kernel stack.
 		 */
-		kernel_stack_bottom = tss.esp0 = _8MB - (_8KB)*i - 4;
+		kernel_stack_bottom = KERNEL_STACK_BOTTOM( process_control_block );
+		set_kernel_stack_bottom( kernel_stack_bottom );
 		
 		if( i != 1 )
 		{
-			/* Push things onto the kernel stack to initialize task switching. */
+			/* 
+			 * It first runs by returning from the PIT handler, which
+			 * lets go of the kernel lock once.
+			 */
+			process_control_block->lock_depth = 1;
+			
+			/* 
+			 * Push things onto the kernel stack to initialize task switching: 
+			 * the iret frame, the registers the PIT handler's wrapper pops, and
+			 * the frame switch_to pops, which returns into that wrapper.
+			 */
 			asm volatile("movl %%esp, %%eax      ;"
 						 "movl %%ebp, %%ebx      ;"
 						 "movl %0, %%ecx		 ;"
@@ -481,17 +650,24 @@ int32_t bootup(void)
 						 "pushl $0               ;"
 						 "pushl $end_pit_handler ;"
 						 "pushl %%ecx            ;"
+						 "pushl $0               ;"
+						 "pushl $0               ;"
+						 "pushl $0               ;"
 						 "movl %%eax, %%esp      ;"
 						 "movl %%ebx, %%ebp      ;"
 						 :: "g"(kernel_stack_bottom), "g"(USER_DS), "g"(USER_CS), 
 							"g"(entry_point): "eax", "ebx", "ecx", "edx");
 		}
 		
-		/* Store KSP and KBP before change. */
+		/* Store KSP before change, where switch_to finds the frame pushed above. */
 		process_control_block->ksp_before_change = 
 			kernel_stack_bottom - INITIAL_KERNEL_STACK_SIZE;
-		process_control_block->kbp_before_change = 
-			kernel_stack_bottom - INITIAL_KERNEL_STACK_SIZE;
+		
+		/* The shells that do not run first wait their turn on the ready queue. */
+		if( i != 1 )
+		{
+			ready_enqueue( process_control_block );
+		}
 
 	
 		/* Call open for stdin and stdout. */
@@ -505,11 +681,7 @@ int32_t bootup(void)
 	memcpy((char *)VIDEO_BUF3, (char *)VIDEO, _4KB);
 	
 	
-	/* Update the running processes bitmask. */
-	running_processes |= INITIAL_SHELLS_BITMASK;
-	
-	current_process_number = 1;
-	
+	/* The last shell set up (on tty 0) is the one that runs first. */
 	/* Enable interrupts */
 	sti();
 	
@@ -523,7 +695,7 @@ int32_t bootup(void)
  * read()
  *
  * Reads 'nbytes' bytes into 'buf' from the file corresponding to the
- * given 'fd'.
+ * given 'fd'. The file's own read operation keeps its position up to date.
  *
  * Inputs:
  * fd: file descriptor
@@ -538,39 +710,25 @@ int32_t read(int32_t fd, void* buf, int32_t nbytes)
 	sti();
 
 	/* Local variables. */
-	int bytesread;
+	file_descriptor_t * file;
 	
-	/* Extract the PCB from the KBP */
-	pcb_t * process_control_block = (pcb_t *)(kernel_stack_bottom & ALIGN_8KB);
+	/* Get the PCB of the running process. */
+	pcb_t * process_control_block = get_current_pcb();
 	
 	/* Check for invalid fd or buf. */
-	if( fd < 0 || fd > 7 || buf == NULL || process_control_block->fds[fd].flags == NOT_IN_USE )
+	if( fd < 0 || fd > 7 || buf == NULL || process_control_block->fds[fd] == NULL )
 	{
 			return -1;
 	}
 
-	/* Get the filename and fileposition of the file with the given fd. */
-	uint8_t* filename = process_control_block->filenames[fd];
-	uint32_t fileposition = process_control_block->fds[fd].fileposition;
+	/* Call the file's read function, if it has one. */
+	file = process_control_block->fds[fd];
+	if( file->fops->read == NULL )
+	{
+		return -1;
+	}
 
-	/* Push arguments for the file's read function and call it. */
-	asm volatile("pushl %0          ;"
-							 "pushl %1              ;"
-							 "pushl %2              ;"
-							 "pushl %3              ;"
-							 "call  *%4             ;"
-							 :
-							 : "g" (fileposition), "g" ((int32_t)filename), "g" (nbytes), "g" ((int32_t)buf),
-							   "g" (process_control_block->fds[fd].jumptable[1]));
-							 
-	/* Store the return value from the read function. */
-	asm volatile("movl %%eax, %0":"=g"(bytesread));
-	asm volatile("addl $16, %esp    ;");
-	
-	/* Update the current file's fileposition. */
-	process_control_block->fds[fd].fileposition += bytesread;
-	
-	return bytesread;
+	return file->fops->read(file, buf, nbytes);
 }
 
 /*
@@ -587,25 +745,26 @@ int32_t read(int32_t fd, void* buf, int32_t nbytes)
  */
 int32_t write(int32_t fd, const void* buf, int32_t nbytes)
 {	
-	/* Extract the PCB from the KBP */
-	pcb_t * process_control_block = (pcb_t *)(kernel_stack_bottom & ALIGN_8KB);
+	/* Local variables. */
+	file_descriptor_t * file;
+
+	/* Get the PCB of the running process. */
+	pcb_t * process_control_block = get_current_pcb();
 	
 	/* Check for invalid fd or buf. */
-	if( fd < 0 || fd > 7 || buf == NULL || process_control_block->fds[fd].flags == NOT_IN_USE )
+	if( fd < 0 || fd > 7 || buf == NULL || process_control_block->fds[fd] == NULL )
 	{
 			return -1;
 	}
 
-	/* Push arguments for the file's write function and call it. */
-	asm volatile("pushl %0          ;"
-				 "pushl %1              ;"
-				 "call  *%2             ;"
-				 "leave					;"
-				 "ret					;"
-				 :
-				 : "g" (nbytes), "g" ((int32_t)buf), "g" (process_control_block->fds[fd].jumptable[2]));
-							 
-	return 0;
+	/* Call the file's write function, if it has one. */
+	file = process_control_block->fds[fd];
+	if( file->fops->write == NULL )
+	{
+		return -1;
+	}
+
+	return file->fops->write(file, buf, nbytes);
 }
 
 /*
@@ -625,9 +784,10 @@ int32_t open(const uint8_t* filename)
 	/* Local variables. */
 	int i;
 	dentry_t tempdentry;
+	file_descriptor_t * file;
 
-	/* Extract the PCB from the KBP */
-	pcb_t * process_control_block = (pcb_t *)(kernel_stack_bottom & ALIGN_8KB);
+	/* Get the PCB of the running process. */
+	pcb_t * process_control_block = get_current_pcb();
 
 	/* Call appropriate function for opening stdin. */
 	if( 0 == strncmp((const int8_t*)filename, (const int8_t*)"stdin", 5) ) 
@@ -654,34 +814,48 @@ int32_t open(const uint8_t* filename)
 	 */
 	for (i=2; i<8; i++) 
 	{
-		if (process_control_block->fds[i].flags == NOT_IN_USE) 
+		if (process_control_block->fds[i] == NULL) 
 		{	
+			file = alloc_file_descriptor();
+			if( file == NULL )
+			{
+				return -1;
+			}
+
 			/* RTC */
 			if (tempdentry.filetype == FILE_TYPE_RTC)
 			{ 		
-				if (-1 == rtc_open()) {
-					return -1;
-				} else {
-					process_control_block->fds[i].jumptable = rtc_fops_table;
-				}
+				file->fops = &rtc_fops;
 			}
 			
 			/* Directory */
 			else if(tempdentry.filetype == FILE_TYPE_DIRECTORY)
 			{ 
-				process_control_block->fds[i].jumptable = dir_fops_table;
+				file->fops = &dir_fops;
 			}
 			
 			/* Regular File */
 			else if(tempdentry.filetype == FILE_TYPE_REGULAR_FILE)
 			{ 
-				process_control_block->fds[i].jumptable = file_fops_table;
+				file->fops = &file_fops;
+			}
+			else
+			{
+				slab_free(file);
+				return -1;
+			}
+
+			/* Resolve the inode once, here, instead of on every read. */
+			file->inode = fs_get_inode(tempdentry.inode);
+			if( -1 == file->fops->open(file) )
+			{
+				slab_free(file);
+				return -1;
 			}
 
-			/* Fill in remaining data and return the new fd. */
-			process_control_block->fds[i].flags = IN_USE;
-			process_control_block->fds[i].inode = tempdentry.inode;
-			strcpy((int8_t*)process_control_block->filenames[i], (const int8_t*)filename);
+			/* Mark the descriptor in use and return it. */
+			file->flags = IN_USE;
+			process_control_block->fds[i] = file;
 			return i;
 		}		
 	}
@@ -701,14 +875,22 @@ int32_t open(const uint8_t* filename)
  */
 void open_stdin( int32_t fd )
 {
-	/* Extract the PCB from the KBP */
-	pcb_t * process_control_block = (pcb_t *)(kernel_stack_bottom & ALIGN_8KB);
+	/* Get the PCB of the running process. */
+	pcb_t * process_control_block = get_current_pcb();
 	
-	/* Set the jumptable -- NOTE: for stdin, we only have a read function. */
-	process_control_block->fds[fd].jumptable = stdin_fops_table;
+	/* Get a fresh descriptor. */
+	file_descriptor_t * file = alloc_file_descriptor();
+	if( file == NULL )
+	{
+		return;
+	}
+	
+	/* Set the fops -- NOTE: for stdin, we only have a read function. */
+	file->fops = &stdin_fops;
 	
 	/* Mark this fd as in use. */
-	process_control_block->fds[fd].flags = IN_USE;
+	file->flags = IN_USE;
+	process_control_block->fds[fd] = file;
 }
 
 /*
@@ -721,21 +903,30 @@ void open_stdin( int32_t fd )
  */
 void open_stdout( int32_t fd )
 {
-	/* Extract the PCB from the KBP */
-	pcb_t * process_control_block = (pcb_t *)(kernel_stack_bottom & ALIGN_8KB);
+	/* Get the PCB of the running process. */
+	pcb_t * process_control_block = get_current_pcb();
+	
+	/* Get a fresh descriptor. */
+	file_descriptor_t * file = alloc_file_descriptor();
+	if( file == NULL )
+	{
+		return;
+	}
 	
-	/* Set the jumptable -- NOTE: for stdout, we only have a write function. */
-	process_control_block->fds[fd].jumptable = stdout_fops_table;
+	/* Set the fops -- NOTE: for stdout, we only have a write function. */
+	file->fops = &stdout_fops;
 	
 	/* Mark this fd as in use. */
-	process_control_block->fds[fd].flags = IN_USE;
+	file->flags = IN_USE;
+	process_control_block->fds[fd] = file;
 }
 
 /*
  * close()
  *
  * Closes the speciﬁed ﬁle descriptor and makes it available for return from
- * later calls to open.
+ * later calls to open. If the file was mapped with mmap, its pages leave
+ * the mmap window.
  *
  * Inputs: the file descriptor we want to close
  * Retvals:
@@ -745,30 +936,26 @@ void open_stdout( int32_t fd )
 int32_t close(int32_t fd)
 {
 	/* Local variables. */
-	uint32_t retval;
+	int32_t retval;
+	file_descriptor_t * file;
 	
-	/* Extract the PCB from the KBP */
-	pcb_t * process_control_block = (pcb_t *)(kernel_stack_bottom & ALIGN_8KB);
+	/* Get the PCB of the running process. */
+	pcb_t * process_control_block = get_current_pcb();
 	
 	/* Check for an invalid fd. */
-	if( fd < 2 || fd > 7 || process_control_block->fds[fd].flags == NOT_IN_USE )
+	if( fd < 2 || fd > 7 || process_control_block->fds[fd] == NULL )
 	{
 		return -1;
 	}
 	
 	/* Call the file's close function. */
-	asm volatile("call  *%0		;"
-				 :
-				 : "g" (process_control_block->fds[fd].jumptable[3]));
-				 
-	/* Store the return value from the close function. */
-	asm volatile("movl %%eax, %0":"=g"(retval));
+	file = process_control_block->fds[fd];
+	retval = ( file->fops->close != NULL ) ? file->fops->close(file) : 0;
 	
-	/* Reset file descriptor information associated with the file. */
-	process_control_block->fds[fd].jumptable = NULL;
-	process_control_block->fds[fd].inode = 0;
-	process_control_block->fds[fd].fileposition = 0;
-	process_control_block->fds[fd].flags = NOT_IN_USE;
+	/* Give the descriptor back and free up its slots. */
+	unmap_file( process_control_block, file );
+	slab_free(file);
+	process_control_block->fds[fd] = NULL;
 	
 	return retval;
 }
@@ -792,8 +979,8 @@ int32_t getargs(uint8_t* buf, int32_t nbytes)
 		return -1;
 	}
 	
-	/* Extract the PCB from the KBP */
-	pcb_t * process_control_block = (pcb_t *)(kernel_stack_bottom & ALIGN_8KB);
+	/* Get the PCB of the running process. */
+	pcb_t * process_control_block = get_current_pcb();
 	
 	/* Ensure we are not asking for less characters than the argbuf (?) */
 	if( strlen((const int8_t*)process_control_block->argbuf) > nbytes )
@@ -872,129 +1059,466 @@ int32_t sigreturn(void)
 }
 
 /*
- * no_function()
+ * mmap()
  *
- * A function that literally does absolutely nothing. 
+ * Maps the data of an open regular file read-only into the calling process's
+ * address space. The file system image is already resident, so its data 
+ * blocks are mapped in place with 4kB page table entries and nothing is 
+ * copied. Each file takes the first free run of pages in the process's
+ * mmap window until it is closed; mapping it again gives the same address.
  *
- * Inputs: none
+ * Inputs: fd - the open file to map
+ *         start - the address of a pointer in user-space that gets the
+ *                 address of the first byte of the file
  * Retvals:
- * 0: always
+ * -1: bad fd, not a regular file, bad 'start' or the window is full
+ * n: the size of the mapped file in bytes
  */
-int32_t no_function(void)
+int32_t mmap(int32_t fd, uint8_t** start)
 {
-	return 0;
+	/* Local variables. */
+	file_descriptor_t * file;
+	uint8_t * block;
+	uint32_t pages;
+	int32_t first;
+	uint32_t i;
+
+	/* Get the PCB of the running process. */
+	pcb_t * process_control_block = get_current_pcb();
+
+	/* Check for an invalid fd. */
+	if( fd < 2 || fd > 7 || process_control_block->fds[fd] == NULL )
+	{
+		return -1;
+	}
+
+	/* Ensure start is within proper bounds. */
+	if( (uint32_t) start < _128MB || (uint32_t) start > (_128MB + _4MB - sizeof(uint8_t *)) )
+	{
+		return -1;
+	}
+
+	/* Only regular files can be mapped, and only if the image is page aligned. */
+	file = process_control_block->fds[fd];
+	if( file->fops != &file_fops || !fs_blocks_mappable() )
+	{
+		return -1;
+	}
+
+	/* A file that is already mapped stays where it is. */
+	if( file->map_pages != 0 )
+	{
+		*start = (uint8_t *)(MMAP_BASE + file->map_start*_4KB);
+		return file->inode->size;
+	}
+
+	/* Find room for the whole file in the window. */
+	pages = (file->inode->size + _4KB - 1) / _4KB;
+	first = mmap_find_slots( process_control_block, pages );
+	if( first < 0 )
+	{
+		return -1;
+	}
+
+	/* Map each of the file's data blocks in order. */
+	for( i = 0; i < pages; i++ )
+	{
+		block = fs_block_address(file->inode, i);
+		if( block == NULL )
+		{
+			while( i-- > 0 )
+			{
+				unmap_mmap_page( process_control_block, first + i );
+			}
+			return -1;
+		}
+		map_mmap_page( process_control_block, first + i, (uint32_t)block );
+	}
+
+	/* Take the slots until the file is closed. */
+	for( i = first; i < first + pages; i++ )
+	{
+		process_control_block->mmap_used[i / 32] |= (1 << (i % 32));
+	}
+	file->map_start = first;
+	file->map_pages = pages;
+
+	*start = (uint8_t *)(MMAP_BASE + first*_4KB);
+
+	return file->inode->size;
 }
 
 /*
- * set_running_processes
+ * setpriority()
  *
- * Set the running_processes variable from an external location. 
+ * Changes the scheduling priority of the calling process. Lower numbers 
+ * run first and get longer time slices; a process only runs when nothing
+ * of a better priority is ready. Children start with their parent's 
+ * priority. Like nice, a process may only lower its own priority: with
+ * strict priorities, one that could raise itself (or lower its rivals)
+ * would keep the shells on its processor from ever running.
  *
- * Inputs: setter value.
+ * Inputs: pid - the calling process's PID, or 0
+ *         priority - its current priority to PRIORITY_LOWEST (7)
+ * Retvals:
+ * -1: another process, or a bad priority
+ * 0: success
+ */
+int32_t setpriority(int32_t pid, int32_t priority)
+{
+	/* Local variables. */
+	pcb_t * process_control_block;
+	
+	process_control_block = get_current_pcb();
+	if( pid != PID_NONE && (uint32_t)pid != process_control_block->process_number )
+	{
+		return -1;
+	}
+	
+	if( priority < 0 || (uint32_t)priority < process_control_block->priority )
+	{
+		return -1;
+	}
+	
+	return sched_set_priority( process_control_block, priority );
+}
+
+/*
+ * set_periodic()
  *
- * Retvals: none
+ * Makes the calling process periodic real-time: in every period of 
+ * 'period_ms' it may run for up to 'budget_ms' ahead of every normal 
+ * process, earliest deadline first. A period of 0 makes it normal again.
+ *
+ * Inputs: period_ms - the length of each period, or 0
+ *         budget_ms - the run time allowed in each period
+ * Retvals:
+ * -1: bad period or budget, or too little processor time left for it
+ * 0: success
  */
-void set_running_processes( uint8_t value )
+int32_t set_periodic(int32_t period_ms, int32_t budget_ms)
 {
-	running_processes = value;
+	if( period_ms < 0 || budget_ms < 0 )
+	{
+		return -1;
+	}
+	
+	return sched_set_periodic( get_current_pcb(), period_ms, budget_ms );
 }
 
 /*
- * get_running_processes
+ * get_rt_stats()
  *
- * Get the running_processes variable for an external location. 
+ * Copies the real-time statistics of a process -- its period and budget,
+ * how many periods have ended and how many of them missed their deadline
+ * -- into a user-level buffer.
  *
- * Inputs: none.
+ * Inputs: pid - the process, or 0 for the calling process
+ *         stats - the user-level buffer
+ * Retvals:
+ * -1: no such process, or a bad buffer
+ * 0: success
+ */
+int32_t get_rt_stats(int32_t pid, rt_stats_t * stats)
+{
+	/* Local variables. */
+	pcb_t * process_control_block;
+	
+	/* Ensure stats is within proper bounds. */
+	if( (uint32_t) stats < _128MB || (uint32_t) stats > (_128MB + _4MB - sizeof(rt_stats_t)) )
+	{
+		return -1;
+	}
+	
+	if( pid == PID_NONE )
+	{
+		process_control_block = get_current_pcb();
+	}
+	else
+	{
+		process_control_block = process_lookup( pid );
+	}
+	
+	if( process_control_block == NULL )
+	{
+		return -1;
+	}
+	
+	sched_get_rt_stats( process_control_block, stats );
+	return 0;
+}
+
+/*
+ * sleep_expired()
  *
- * Retvals: getter value.
+ * What the timer of a sleep calls: wakes the sleeping process.
+ *
+ * Inputs: timer - the timer, whose data is the wait queue to wake
+ *         count - unused
+ * Retvals: none
  */
-uint8_t get_running_processes( void )
+static void sleep_expired(ktimer_t * timer, uint32_t count)
 {
-	return running_processes;
+	wake_up( (wait_queue_t *)timer->data );
 }
 
 /*
- * set_kernel_stack_bottom
+ * sleep()
  *
- * Set the running_processes variable from an external location. 
+ * Blocks the calling process for at least 'ms' milliseconds, on a kernel
+ * timer, without using the processor or the RTC meanwhile.
  *
- * Inputs: setter value.
+ * Inputs: ms - how long to sleep, at most KTIMER_MAX_MS
+ * Retvals:
+ * -1: bad time
+ * 0: success
+ */
+int32_t sleep(int32_t ms)
+{
+	/* Local variables. */
+	ktimer_t timer;
+	wait_queue_t queue;
+	uint32_t flags;
+	
+	if( ms < 0 || ms > KTIMER_MAX_MS )
+	{
+		return -1;
+	}
+	if( ms == 0 )
+	{
+		return 0;
+	}
+	
+	memset(&timer, 0, sizeof(ktimer_t));
+	queue.head = NULL;
+	ktimer_setup( &timer, sleep_expired, &queue );
+	
+	/* 
+	 * The clock only counts whole milliseconds, so part of the current
+	 * one may already be gone: wait for one more.
+	 */
+	cli_and_save(flags);
+	ktimer_add( &timer, sched_now_ms() + ms + 1 );
+	while( timer.pending )
+	{
+		sleep_on( &queue );
+	}
+	restore_flags(flags);
+	
+	return 0;
+}
+
+/*
+ * alarm_expired()
  *
+ * What the timer of an alarm calls: counts the periods that ended, and
+ * wakes the process if it is in pause.
+ *
+ * Inputs: timer - the timer, whose data is the process
+ *         count - the number of periods that ended
  * Retvals: none
  */
-void set_kernel_stack_bottom( uint32_t value )
+static void alarm_expired(ktimer_t * timer, uint32_t count)
 {
-	kernel_stack_bottom = value;
+	/* Local variables. */
+	pcb_t * process_control_block = (pcb_t *)timer->data;
+	
+	process_control_block->alarm_count += count;
+	wake_up( &process_control_block->alarm_wait );
 }
 
 /*
- * get_kernel_stack_bottom
+ * alarm()
  *
- * Gets kernel_stack_bottom.
+ * Starts a periodic alarm for the calling process, going off every 
+ * 'period_ms' milliseconds from now, replacing the one it had. A period
+ * of 0 stops the alarm. The process waits for it with pause.
  *
- * Inputs: none.
+ * Inputs: period_ms - the time between alarms, at most KTIMER_MAX_MS, or 0
+ * Retvals:
+ * -1: bad period, or out of memory
+ * 0: success
+ */
+int32_t alarm(int32_t period_ms)
+{
+	/* Local variables. */
+	pcb_t * process_control_block = get_current_pcb();
+	ktimer_t * timer;
+	
+	if( period_ms < 0 || period_ms > KTIMER_MAX_MS )
+	{
+		return -1;
+	}
+	
+	cancel_alarm( process_control_block );
+	if( period_ms == 0 )
+	{
+		return 0;
+	}
+	
+	timer = ktimer_alloc();
+	if( timer == NULL )
+	{
+		return -1;
+	}
+	
+	ktimer_setup( timer, alarm_expired, process_control_block );
+	timer->period = period_ms;
+	process_control_block->alarm = timer;
+	ktimer_add( timer, sched_now_ms() + period_ms );
+	
+	return 0;
+}
+
+/*
+ * pause()
  *
- * Retvals: getter value.
+ * Blocks the calling process until its alarm goes off, unless it already
+ * has since the last pause.
+ *
+ * Inputs: none
+ * Retvals:
+ * -1: the process has no alarm
+ * the number of times the alarm went off since the last pause otherwise
  */
-uint32_t get_kernel_stack_bottom( void )
+int32_t pause(void)
 {
-	return kernel_stack_bottom;
+	/* Local variables. */
+	pcb_t * process_control_block = get_current_pcb();
+	uint32_t flags;
+	int32_t count;
+	
+	cli_and_save(flags);
+	
+	while( process_control_block->alarm != NULL && process_control_block->alarm_count == 0 )
+	{
+		sleep_on( &process_control_block->alarm_wait );
+	}
+	
+	if( process_control_block->alarm == NULL )
+	{
+		restore_flags(flags);
+		return -1;
+	}
+	
+	count = process_control_block->alarm_count;
+	process_control_block->alarm_count = 0;
+	
+	restore_flags(flags);
+	return count;
 }
 
 /*
- * set_page_dir_addr
+ * clock_gettime()
  *
- * Sets page_dir_addr
+ * Copies the time of a clock into a user-level buffer. The only clock is
+ * CLOCK_MONOTONIC: the time since boot, from the TSC, to the nanosecond.
  *
- * Inputs: setter value.
+ * Inputs: clock_id - the clock to read
+ *         ts - the user-level buffer
+ * Retvals:
+ * -1: no such clock, or a bad buffer
+ * 0: success
+ */
+int32_t clock_gettime(int32_t clock_id, timespec_t * ts)
+{
+	/* Local variables. */
+	uint64_t ns;
+	
+	/* Ensure ts is within proper bounds. */
+	if( (uint32_t) ts < _128MB || (uint32_t) ts > (_128MB + _4MB - sizeof(timespec_t)) )
+	{
+		return -1;
+	}
+	
+	if( clock_id != CLOCK_MONOTONIC )
+	{
+		return -1;
+	}
+	
+	ns = sched_clock_ns();
+	ts->sec = div64_32(ns, NS_PER_SEC);
+	ts->nsec = (uint32_t)(ns - (uint64_t)ts->sec * NS_PER_SEC);
+	return 0;
+}
+
+/*
+ * fd_init()
+ *
+ * Description:
+ * Sets up the cache the file descriptors of every process come from.
+ * Must run after slab_init.
  *
+ * Inputs: none
  * Retvals: none
  */
-void set_page_dir_addr( uint32_t value )
+void fd_init(void)
 {
-	page_dir_addr = value;
+	slab_cache_init(&fd_cache, "file_descriptor", sizeof(file_descriptor_t));
 }
 
 /*
- * get_page_dir_addr
- *
- * Gets page_dir_addr.
+ * sysenter_init()
  *
- * Inputs: none.
+ * Sets up SYSENTER on the processor running this, if it has it: the
+ * kernel's code segment, sysenter_handler, and for the stack, this 
+ * processor's TSS, whose esp0 field the handler loads the current kernel
+ * stack from (see set_kernel_stack_bottom). int 0x80 keeps working. Runs
+ * on every processor once its TSS is loaded; the boot processor's answer
+ * goes in every process's data page, so programs know to use it.
  *
- * Retvals: getter value.
+ * Inputs: none
+ * Retvals: none
  */
-uint32_t get_page_dir_addr( void )
+void sysenter_init(void)
 {
-	return page_dir_addr;
+	/* Local variables. */
+	uint32_t eax, ebx, ecx, edx;
+	
+	cpuid(CPUID_FEATURES, &eax, &ebx, &ecx, &edx);
+	if( !(edx & CPUID_EDX_SEP) )
+	{
+		return;
+	}
+	
+	wrmsr(MSR_SYSENTER_CS, KERNEL_CS);
+	wrmsr(MSR_SYSENTER_ESP, (uint32_t)&this_cpu()->tss->esp0);
+	wrmsr(MSR_SYSENTER_EIP, (uint32_t)sysenter_handler);
+	
+	if( this_cpu() == &cpus[0] )
+	{
+		sysenter_active = 1;
+	}
 }
 
 /*
- * set_current_process_number
+ * set_kernel_stack_bottom
  *
- * Sets current_process_number
+ * Sets the kernel stack bottom of this processor's current process, and
+ * the esp0 of its TSS, which points at the same stack.
  *
  * Inputs: setter value.
  *
  * Retvals: none
  */
-void set_current_process_number( uint8_t value )
+void set_kernel_stack_bottom( uint32_t value )
 {
-	current_process_number = value;
+	this_cpu()->kernel_stack_bottom = value;
+	this_cpu()->tss->esp0 = value;
 }
 
 /*
- * get_current_process_number
+ * get_kernel_stack_bottom
  *
- * Gets current_process_number.
+ * Gets the kernel stack bottom of this processor's current process.
  *
  * Inputs: none.
  *
  * Retvals: getter value.
  */
-uint8_t get_current_process_number( void )
+uint32_t get_kernel_stack_bottom( void )
 {
-	return current_process_number;
+	return this_cpu()->kernel_stack_bottom;
 }
 
 /*
@@ -1008,8 +1532,8 @@ uint8_t get_current_process_number( void )
  */
 uint32_t get_tty_number( void )
 {
-	/* Extract the PCB from the KBP */
-	pcb_t * process_control_block = (pcb_t *)(kernel_stack_bottom & ALIGN_8KB);
+	/* Get the PCB of the running process. */
+	pcb_t * process_control_block = get_current_pcb();
 	
 	return process_control_block->tty_number;
 }
@@ -8,6 +8,9 @@
 
 #include "files.h"
 #include "paging.h"
+#include "scheduler.h"
+#include "ktimer.h"
+#include "vdso.h"
 
 
 
@@ -19,67 +22,100 @@
 #define		FILE_TYPE_REGULAR_FILE	   2
 #define     PROGRAM_LOAD_ADDR          0x08048000
 #define     ENTRY_POINT_OFFSET         24
-#define     INITIAL_SHELLS_BITMASK     0x70
-#define     INITIAL_KERNEL_STACK_SIZE  60
+#define     PROGRAM_HEADER_SIZE        28
+#define     NUM_INITIAL_SHELLS         3
+#define     INITIAL_KERNEL_STACK_SIZE  72
+
+/* 
+ * The fast system call entry: SYSENTER loads CS (and SS, 8 above it), 
+ * ESP and EIP from these MSRs. The GDT has the user segments 16 and 24
+ * above KERNEL_CS, where SYSEXIT expects them.
+ */
+#define     MSR_SYSENTER_CS            0x174
+#define     MSR_SYSENTER_ESP           0x175
+#define     MSR_SYSENTER_EIP           0x176
+#define     CPUID_EDX_SEP              (1 << 11)
 
+/* The words of the bitmap of the mmap window's slots (see pcb_t). */
+#define     MMAP_BITMAP_WORDS          ((VDSO_PAGE + 31) / 32)
 
-/*** STRUCTS ***/
-/* Explanation: 
- * This is the file descriptor used in the fds array for each process's PCB
- *    jumptable -- A pointer to a file operations table for this file.
- *                 The fops table has functions like open, close, read, and write.
- *    inode -- The inode number of this file in the file system.
- *    fileposition -- The current position within the file that we are reading.
- *                    This will increment through the file as we read it.
- *    flags -- The only flag contained within this member is IN_USE or NOT_IN_USE.
- *             It is used to figure out which fds are available for use when trying
- *             to open a new file in a process.
- */
-typedef struct file_descriptor_t {
-	uint32_t * jumptable;
-	int32_t inode;
-	int32_t fileposition;
-	int32_t flags;
-} file_descriptor_t;
 
+/*** STRUCTS ***/
 /* Explanation:
  * This is the PCB structure used by each process.  It is like a header that
  * contains all the relevant information that the OS might need to know as it
  * manipulates its processes.
  *    fds[8] -- The array of file descriptors, which represent each file that the
- *              process has open.
- *    filenames[8][32] -- An array holding the names of each of the open files
- *                        for quick access by the OS.
+ *              process has open. Unused slots are NULL; the descriptors
+ *              themselves come from the file descriptor cache.
  *    parent_ksp -- The kernel stack pointer of the parent process.  This is used
  *                  to revert back to the parent kernel stack when we halt.
  *    parent_kbp -- The kernel base pointer of the parent process.  This is used
  *  				to revert back to the parent kernel stack when we halt.
- *    process_number -- The process number of this process.  It is a number from
- *                      1-7 (process 0 is the "no processes running" process).
- *    parent_process_number -- The process number of the parent process.  It is a
- *  						   number from 1-7 (process 0 is the "no processes running"
- *  						   process).
+ *    process_number -- The PID of this process, its index in the process table.
+ *                      PID 0 (PID_NONE) is the "no processes running" process.
+ *    parent_process_number -- The PID of the parent process, or PID_NONE for
+ *                             the shells started at boot.
  *    argbuf -- Buffer for the arguments of this process.
  *    has_child -- Flag that indicates whether this process has a child process.
  *  			   If it has a child process, it will not be scheduled.
  *    tty_number -- The number of the tty in which this process is running.
  *    ksp_before_change -- This variable stores the KSP right before switching
- *  					   processes.
- *    kbp_before_change -- This variable stores the KBP right before switching
- *  					processes.
+ *  					   processes, where switch_to saved its registers.
+ *    mmap_used -- Bit i is set while slot i of the mmap window is mapped.
+ *    program_image -- The inode of the executable this process is running. Its
+ *                     pages are copied in from here as the program touches them.
+ *    page_directory -- This process's page directory.
+ *    program_page_table -- The page table mapping the 4MB program image.
+ *    mmap_page_table -- The page table mapping the mmap window.
+ *    vdso -- Its data page, mapped read-only at VDSO_ADDR (see vdso.h).
+ *    kernel_stack -- The 8kB block holding this process's kernel stack.
+ *    state -- TASK_RUNNABLE, or TASK_BLOCKED while it sleeps on a wait queue.
+ *    wait_next -- The next process on the same wait queue.
+ *    run_next, run_prev -- Links in the ready queue of this process's priority.
+ *    priority -- PRIORITY_HIGHEST (0) to PRIORITY_LOWEST (7); see scheduler.h.
+ *    ticks_left -- The PIT ticks left in this process's time slice.
+ *    rt -- The real-time state, when the process is periodic.
+ *    cpu -- The index of the processor it last ran on, whose ready queue
+ *           it goes back on.
+ *    lock_depth -- How many times it held the kernel lock when it was
+ *                  switched out (see schedule).
+ *    alarm -- The timer of its periodic alarm, or NULL.
+ *    alarm_count -- How many times the alarm went off since the last pause.
+ *    alarm_wait -- Where it waits in pause.
+ *    next, prev -- Links in the circular list of live processes.
  */
 typedef struct pcb_t {
-	file_descriptor_t fds[8];
-	uint8_t filenames[8][32]; 
+	file_descriptor_t * fds[8];
 	uint32_t parent_ksp;
 	uint32_t parent_kbp;
-	uint8_t process_number;
-	uint8_t parent_process_number;
+	uint32_t process_number;
+	uint32_t parent_process_number;
 	uint8_t argbuf[100];
 	uint32_t has_child;
 	uint32_t tty_number;
 	uint32_t ksp_before_change;
-	uint32_t kbp_before_change;
+	uint32_t mmap_used[MMAP_BITMAP_WORDS];
+	inode_t * program_image;
+	page_directory_t * page_directory;
+	pte_4KB_t * program_page_table;
+	pte_4KB_t * mmap_page_table;
+	vdso_data_t * vdso;
+	uint32_t kernel_stack;
+	uint32_t state;
+	struct pcb_t * wait_next;
+	struct pcb_t * run_next;
+	struct pcb_t * run_prev;
+	uint32_t priority;
+	uint32_t ticks_left;
+	rt_task_t rt;
+	uint32_t cpu;
+	uint32_t lock_depth;
+	ktimer_t * alarm;
+	uint32_t alarm_count;
+	wait_queue_t alarm_wait;
+	struct pcb_t * next;
+	struct pcb_t * prev;
 } pcb_t;
 
 
@@ -128,8 +164,41 @@ int32_t set_handler(int32_t signum, void* handler_address);
 /* Related to signal handling. */
 int32_t sigreturn(void);
 
+/* Maps an open file's data read-only into user space. */
+int32_t mmap(int32_t fd, uint8_t** start);
+
+/* Changes the scheduling priority of a process. */
+int32_t setpriority(int32_t pid, int32_t priority);
+
+/* Makes the calling process periodic real-time, or normal again. */
+int32_t set_periodic(int32_t period_ms, int32_t budget_ms);
+
+/* Reads the real-time statistics of a process. */
+int32_t get_rt_stats(int32_t pid, rt_stats_t * stats);
+
+/* Blocks the calling process for a number of milliseconds. */
+int32_t sleep(int32_t ms);
+
+/* Starts or stops the calling process's periodic alarm. */
+int32_t alarm(int32_t period_ms);
+
+/* Blocks the calling process until its alarm goes off. */
+int32_t pause(void);
+
+/* Reads the time of a clock. */
+int32_t clock_gettime(int32_t clock_id, timespec_t * ts);
+
 
 /*** Other functions ***/ 
+/* Sets up the cache file descriptors are allocated from. */
+void fd_init(void);
+
+/* Set once the processors take system calls through SYSENTER as well. */
+extern uint32_t sysenter_active;
+
+/* Sets up the fast system call entry on the processor running this. */
+void sysenter_init(void);
+
 /* Called when we need to open stdin to initialize a new process. */
 void open_stdin( int32_t fd );
 
@@ -139,30 +208,15 @@ void open_stdout( int32_t fd );
 /*  Our test function for the execute syscall. */
 void execute_test(void);
 
-/* A function that literally does absolutely nothing. */
-int32_t no_function(void);
-
 /* Loads the initial three shells and jumps to the entry point of the first one. */
 int32_t bootup(void);
 
 
 /*** Set/Get functions ***/
 /* Setter function */
-void set_running_processes( uint8_t value );
-/* Getter function */
-uint8_t get_running_processes( void );
-/* Setter function */
 void set_kernel_stack_bottom( uint32_t value );
 /* Getter function */
 uint32_t get_kernel_stack_bottom( void );
-/* Setter function */
-void set_page_dir_addr( uint32_t value );
-/* Getter function */
-uint32_t get_page_dir_addr( void );
-/* Setter function */
-void set_current_process_number( uint8_t value );
-/* Getter function */
-uint8_t get_current_process_number( void );
 /* Getter function */
 uint32_t get_tty_number( void );
 
@@ -0,0 +1,46 @@
+/*************************************************/
+/* vdso.c - The data page every process can read */
+/*          without a system call.               */
+/*************************************************/
+#include "vdso.h"
+#include "lib.h"
+#include "syscalls.h"
+#include "scheduler.h"
+
+
+
+/* 
+ * Fail to compile if vdso_data_t no longer matches the layout the user 
+ * programs were built against (an array of negative size is an error).
+ */
+typedef char vdso_sysenter_offset_check
+	[(__builtin_offsetof(vdso_data_t, sysenter) == VDSO_SYSENTER_OFFSET) ? 1 : -1];
+typedef char vdso_data_size_check[(sizeof(vdso_data_t) == VDSO_DATA_SIZE) ? 1 : -1];
+
+
+
+/*
+ * vdso_fill()
+ *
+ * Description:
+ * Fills in the data page of a new process (allocated and mapped by 
+ * setup_new_task), once its PID and terminal are known.
+ *
+ * Inputs: pcb - the process
+ * Retvals: none
+ */
+void vdso_fill(pcb_t * pcb)
+{
+	/* Local variables. */
+	vdso_data_t * data = pcb->vdso;
+
+	memset(data, 0, _4KB);
+	data->pid = pcb->process_number;
+	data->tty_number = pcb->tty_number;
+	data->tsc_boot = tsc_boot;
+	data->tsc_per_tick = tsc_per_tick;
+	data->tsc_per_ms = tsc_per_ms;
+	data->tsc_ns_mult = tsc_ns_mult;
+	data->tsc_ns_shift = TSC_NS_SHIFT;
+	data->sysenter = sysenter_active;
+}
@@ -0,0 +1,68 @@
+/*************************************************/
+/* vdso.h - The data page every process can read */
+/*          without a system call.               */
+/*************************************************/
+#ifndef VDSO_H
+#define VDSO_H
+
+
+
+#include "types.h"
+#include "paging.h"
+
+
+
+/* 
+ * Where the page is mapped, read-only, in every process: the last page of
+ * the mmap window, which mmap never hands out.
+ */
+#define VDSO_PAGE		(MAX_PAGE_TABLE_SIZE - 1)
+#define VDSO_ADDR		(MMAP_BASE + VDSO_PAGE * _4KB)
+
+
+
+struct pcb_t;
+
+/* Explanation:
+ * The data page of a process. The scheduler has no periodic tick to 
+ * update a clock with, so instead of the time the page holds the TSC
+ * calibration, and the process reads the TSC itself (rdtsc works in user
+ * space) to get the same ticks and nanoseconds as the kernel's clock (see
+ * sched_clock_ns). Nothing on it changes while the process runs.
+ *    pid -- The process number.
+ *    tty_number -- The terminal the process runs on.
+ *    tsc_boot -- The TSC value at tick 0.
+ *    tsc_per_tick -- TSC cycles per scheduler tick (MS_PER_TICK).
+ *    tsc_per_ms -- TSC cycles per millisecond.
+ *    tsc_ns_mult -- Nanoseconds per TSC cycle, shifted left by tsc_ns_shift.
+ *    tsc_ns_shift -- TSC_NS_SHIFT.
+ *    sysenter -- Set if system calls can be made with SYSENTER, as well as
+ *                int $0x80 (see sysenter_init).
+ */
+typedef struct vdso_data_t {
+	uint32_t pid;
+	uint32_t tty_number;
+	uint64_t tsc_boot;
+	uint32_t tsc_per_tick;
+	uint32_t tsc_per_ms;
+	uint32_t tsc_ns_mult;
+	uint32_t tsc_ns_shift;
+	uint32_t sysenter;
+} vdso_data_t;
+
+/* 
+ * Where sysenter sits in the page. The user programs' start up code reads
+ * it from assembly (ECE391_VDSO_SYSENTER in ece391support.h), so it must
+ * not move; vdso.c checks it at compile time, and so does the size.
+ */
+#define VDSO_SYSENTER_OFFSET	32
+#define VDSO_DATA_SIZE			36
+
+
+
+/* Fills in the data page of a new process. */
+void vdso_fill(struct pcb_t * pcb);
+
+
+
+#endif /* VDSO_H */
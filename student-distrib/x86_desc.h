@@ -16,6 +16,14 @@
 #define KERNEL_TSS 0x0030
 #define KERNEL_LDT 0x0038
 
+/* 
+ * The most processors the kernel runs on. The boot processor uses 
+ * KERNEL_TSS; processor i > 0 has its own TSS, at selector
+ * CPU_TSS_BASE + (i - 1) * 8.
+ */
+#define MAX_CPUS 8
+#define CPU_TSS_BASE 0x0040
+
 /* Size of the task state segment (TSS) */
 #define TSS_SIZE 104
 
@@ -198,14 +206,18 @@ extern uint32_t tss_size;
 extern seg_desc_t tss_desc_ptr;
 extern tss_t tss;
 
-/* An array of page directories, one for each process. */
-page_directory_t page_directories[8] __attribute__((aligned (0x1000)));
+/* The TSS descriptors of the processors other than the boot processor */
+extern seg_desc_t cpu_tss_desc_ptr[MAX_CPUS - 1];
+
+/* 
+ * The page directory used before any process runs. Processes get their own,
+ * allocated by setup_new_task.
+ */
+page_directory_t page_directories[1] __attribute__((aligned (0x1000)));
 
 /* Page table entries (declared in x86_desc.S) */
 pte_4KB_t page_table[MAX_PAGE_TABLE_SIZE] __attribute__((aligned (0x1000)));
 
-pte_4KB_t new_page_table[MAX_PAGE_TABLE_SIZE] __attribute__((aligned (0x1000)));
-
 
 
 /* Sets runtime-settable parameters in the GDT entry for the LDT */
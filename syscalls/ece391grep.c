@@ -6,17 +6,53 @@
 #define BUFSIZE 1024
 #define SBUFSIZE 33
 
+int32_t
+do_mapped_file (const char* s, const char* fname, const uint8_t* data,
+		int32_t size)
+{
+    int32_t line_start, line_end, check, s_len;
+
+    s_len = ece391_strlen ((uint8_t*)s);
+    for (line_start = 0; line_start < size; line_start = line_end + 1) {
+	line_end = line_start;
+	while (line_end < size && '\n' != data[line_end])
+	    line_end++;
+	/* search the line */
+	for (check = line_start; check + s_len <= line_end; check++) {
+	    if (s[0] == data[check] && 
+		0 == ece391_strncmp (data + check, (uint8_t*)s, s_len)) {
+		ece391_fdputs (1, (uint8_t*)fname);
+		ece391_fdputs (1, (uint8_t*)":");
+		ece391_write (1, data + line_start, line_end - line_start);
+		ece391_fdputs (1, (uint8_t*)"\n");
+		break;
+	    }
+	}
+    }
+    return 0;
+}
+
 int32_t
 do_one_file (const char* s, const char* fname) 
 {
     int32_t fd, cnt, last, line_start, line_end, check, s_len;
     uint8_t data[BUFSIZE+1];
+    uint8_t* mapped;
 
     s_len = ece391_strlen ((uint8_t*)s);
     if (-1 == (fd = ece391_open ((uint8_t*)fname))) {
         ece391_fdputs (1, (uint8_t*)"file open failed\n");
         return -1;
     }
+    /* scan the file in place if it can be mapped */
+    if (-1 != (cnt = ece391_mmap (fd, &mapped))) {
+	do_mapped_file (s, fname, mapped, cnt);
+	if (-1 == ece391_close (fd)) {
+	    ece391_fdputs (1, (uint8_t*)"file close failed\n");
+	    return -1;
+	}
+	return 0;
+    }
     last = 0;
     while (1) {
         cnt = ece391_read (fd, data + last, BUFSIZE - last);
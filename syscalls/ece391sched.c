@@ -36,6 +36,9 @@ int main ()
 		}
 	}
 
+	/* Print in the background, so the shells stay responsive. */
+	ece391_setpriority (0, PRIORITY_LOWEST);
+
 	for (val = 0; val < cnt; val++)
 	{
 		itoa(val+1, buf, 10);
@@ -104,4 +104,72 @@ strrev(int8_t* s)
         }
 
         return s;
-}
\ No newline at end of file
+}
+/* The sysenter field must be where _start looks for it */
+typedef char vdso_sysenter_check
+    [(__builtin_offsetof (ece391_vdso_data_t, sysenter) ==
+      ECE391_VDSO_SYSENTER_OFFSET) ? 1 : -1];
+
+/* The data page, and the TSC since tick 0 */
+static volatile ece391_vdso_data_t* const vdso =
+    (volatile ece391_vdso_data_t*)ECE391_VDSO_ADDR;
+
+static uint64_t
+vdso_cycles (void)
+{
+    uint32_t low, high;
+
+    asm volatile ("rdtsc" : "=a" (low), "=d" (high));
+    return (((uint64_t)high << 32) | low) - vdso->tsc_boot;
+}
+
+/* Divide a 64-bit number by a 32-bit one; the quotient must fit in 32 bits */
+static uint32_t
+vdso_div (uint64_t n, uint32_t d, uint32_t* rem)
+{
+    uint32_t q, r;
+
+    asm ("divl %4"
+	 : "=a" (q), "=d" (r)
+	 : "a" ((uint32_t)n), "d" ((uint32_t)(n >> 32)), "rm" (d));
+    *rem = r;
+    return q;
+}
+
+uint32_t
+ece391_vdso_getpid (void)
+{
+    return vdso->pid;
+}
+
+uint32_t
+ece391_vdso_gettty (void)
+{
+    return vdso->tty_number;
+}
+
+uint32_t
+ece391_vdso_getticks (void)
+{
+    uint32_t rem;
+
+    return vdso_div (vdso_cycles (), vdso->tsc_per_tick, &rem);
+}
+
+int32_t
+ece391_vdso_clock_gettime (ece391_timespec_t* ts)
+{
+    uint64_t cycles = vdso_cycles ();
+    uint64_t ns;
+    uint32_t nsec;
+
+    /* Nanoseconds, multiplied in two halves so nothing overflows */
+    ns = (((uint64_t)(uint32_t)(cycles >> 32) * vdso->tsc_ns_mult)
+	  << (32 - vdso->tsc_ns_shift)) +
+	 (((uint64_t)(uint32_t)cycles * vdso->tsc_ns_mult)
+	  >> vdso->tsc_ns_shift);
+
+    ts->sec = vdso_div (ns, 1000000000, &nsec);
+    ts->nsec = nsec;
+    return 0;
+}
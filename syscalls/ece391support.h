@@ -1,6 +1,21 @@
 #if !defined(ECE391SUPPORT_H)
 #define ECE391SUPPORT_H
 
+/*
+ * The data page the kernel maps read-only into every process, at the end
+ * of the mmap window. Its helpers answer without a system call: the PID,
+ * the terminal, the scheduler tick, and the same monotonic clock as
+ * ece391_clock_gettime, computed from the TSC and the kernel's
+ * calibration. The start up code in ece391syscall.S reads the sysenter
+ * field, so its offset (VDSO_SYSENTER_OFFSET in the kernel's vdso.h) is
+ * defined here too, where assembly can use it.
+ */
+#define ECE391_VDSO_ADDR 0x8BFF000
+#define ECE391_VDSO_SYSENTER_OFFSET 32
+#define ECE391_VDSO_SYSENTER (ECE391_VDSO_ADDR + ECE391_VDSO_SYSENTER_OFFSET)
+
+#if !defined(__ASSEMBLER__)
+
 extern uint32_t ece391_strlen (const uint8_t* s);
 extern void ece391_strcpy (uint8_t* dst, const uint8_t* src);
 extern void ece391_fdputs (int32_t fd, const uint8_t* s);
@@ -9,4 +24,24 @@ extern int32_t ece391_strncmp (const uint8_t* s1, const uint8_t* s2,
 			       uint32_t n);
 extern int8_t *itoa(uint32_t value, int8_t* buf, int32_t radix);
 extern int8_t *strrev(int8_t* s);
+
+typedef struct ece391_vdso_data {
+	uint32_t pid;
+	uint32_t tty_number;
+	uint64_t tsc_boot;
+	uint32_t tsc_per_tick;
+	uint32_t tsc_per_ms;
+	uint32_t tsc_ns_mult;
+	uint32_t tsc_ns_shift;
+	uint32_t sysenter;
+} ece391_vdso_data_t;
+
+struct ece391_timespec;
+
+extern uint32_t ece391_vdso_getpid (void);
+extern uint32_t ece391_vdso_gettty (void);
+extern uint32_t ece391_vdso_getticks (void);
+extern int32_t ece391_vdso_clock_gettime (struct ece391_timespec* ts);
+
+#endif /* !__ASSEMBLER__ */
 #endif /* ECE391SUPPORT_H */
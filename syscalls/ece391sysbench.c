@@ -0,0 +1,68 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+#define CALLS 100000
+
+/* Read the time stamp counter */
+static uint64_t
+rdtsc (void)
+{
+    uint32_t low, high;
+
+    asm volatile ("rdtsc" : "=a" (low), "=d" (high));
+    return ((uint64_t)high << 32) | low;
+}
+
+/* Average cycles for one round trip into the kernel and back, through
+   the given entry; set_handler does nothing, so it is all entry cost */
+static uint32_t
+time_calls (void* entry)
+{
+    void* saved = ece391_syscall_entry;
+    uint64_t start;
+    uint32_t cycles;
+    int32_t i;
+
+    ece391_syscall_entry = entry;
+    start = rdtsc ();
+    for (i = 0; i < CALLS; i++)
+	ece391_set_handler (0, 0);
+    cycles = (uint32_t)(rdtsc () - start);
+    ece391_syscall_entry = saved;
+
+    return cycles / CALLS;
+}
+
+static void
+print_cycles (const char* label, uint32_t cycles)
+{
+    int8_t buf[12];
+
+    ece391_fdputs (1, (uint8_t*)label);
+    ece391_fdputs (1, (uint8_t*)itoa (cycles, buf, 10));
+    ece391_fdputs (1, (uint8_t*)" cycles/call\n");
+}
+
+int main ()
+{
+    volatile ece391_vdso_data_t* vdso =
+	(volatile ece391_vdso_data_t*)ECE391_VDSO_ADDR;
+    uint32_t slow, fast;
+
+    slow = time_calls (ece391_int80);
+    print_cycles ("int $0x80: ", slow);
+
+    if (!vdso->sysenter) {
+	ece391_fdputs (1, (uint8_t*)"sysenter: not available\n");
+	return 0;
+    }
+
+    fast = time_calls (ece391_sysenter);
+    print_cycles ("sysenter:  ", fast);
+    if (slow > fast)
+	print_cycles ("saved:     ", slow - fast);
+
+    return 0;
+}
@@ -21,6 +21,72 @@ extern int32_t ece391_getargs (uint8_t* buf, int32_t nbytes);
 extern int32_t ece391_vidmap (uint8_t** screen_start);
 extern int32_t ece391_set_handler (int32_t signum, void* handler);
 extern int32_t ece391_sigreturn (void);
+extern int32_t ece391_mmap (int32_t fd, uint8_t** start);
+
+/* 
+ * Priorities run from 0 (highest) to 7 (lowest); new processes start at 4
+ * or their parent's priority. A process may only lower its own priority;
+ * pid is 0 or its own PID.
+ */
+extern int32_t ece391_setpriority (int32_t pid, int32_t priority);
+
+#define PRIORITY_HIGHEST 0
+#define PRIORITY_DEFAULT 4
+#define PRIORITY_LOWEST  7
+
+/*
+ * Periodic real-time scheduling: in every period the calling process may
+ * run for up to budget_ms ahead of every normal process, earliest deadline
+ * first. A period that ends before the process blocks again (e.g. in an
+ * RTC read) is a deadline miss. A period of 0 makes the process normal 
+ * again. Times are rounded up to the 30ms scheduler tick; the budget must
+ * then be shorter than the period, and all periodic processes together may
+ * use at most 70% of the processor.
+ */
+typedef struct ece391_rt_stats {
+	uint32_t period_ms;
+	uint32_t budget_ms;
+	uint32_t periods;
+	uint32_t deadline_misses;
+} ece391_rt_stats_t;
+
+extern int32_t ece391_set_periodic (int32_t period_ms, int32_t budget_ms);
+extern int32_t ece391_get_rt_stats (int32_t pid, ece391_rt_stats_t* stats);
+
+/*
+ * Kernel timers, counted in milliseconds. sleep blocks for at least 'ms'.
+ * alarm starts a periodic alarm going off every 'period_ms' from now
+ * (replacing any earlier one; 0 stops it), and pause blocks until it next
+ * goes off, returning how many times it went off since the last pause
+ * (more than 1 if the program fell behind), or -1 without an alarm.
+ */
+extern int32_t ece391_sleep (int32_t ms);
+extern int32_t ece391_alarm (int32_t period_ms);
+extern int32_t ece391_pause (void);
+
+/*
+ * The time since boot, to the nanosecond, from the kernel's monotonic
+ * clock. CLOCK_MONOTONIC is the only clock.
+ */
+typedef struct ece391_timespec {
+	uint32_t sec;
+	uint32_t nsec;
+} ece391_timespec_t;
+
+#define CLOCK_MONOTONIC 1
+
+extern int32_t ece391_clock_gettime (int32_t clock_id, ece391_timespec_t* ts);
+
+/*
+ * Every call above enters the kernel through ece391_syscall_entry, which
+ * _start points at ece391_sysenter when the kernel takes SYSENTER, and
+ * leaves at ece391_int80 otherwise. Both take the call number in EAX and
+ * the arguments in EBX, ECX and EDX; they are not meant to be called from
+ * C, only stored in ece391_syscall_entry.
+ */
+extern void* ece391_syscall_entry;
+extern void ece391_int80 (void);
+extern void ece391_sysenter (void);
 
 enum signums {
 	DIV_ZERO = 0,
@@ -11,5 +11,13 @@
 #define SYS_VIDMAP  8
 #define SYS_SET_HANDLER  9
 #define SYS_SIGRETURN  10
+#define SYS_MMAP    11
+#define SYS_SETPRIORITY  12
+#define SYS_SET_PERIODIC 13
+#define SYS_GET_RT_STATS 14
+#define SYS_SLEEP   15
+#define SYS_ALARM   16
+#define SYS_PAUSE   17
+#define SYS_CLOCK_GETTIME 18
 
 #endif /* ECE391SYSNUM_H */